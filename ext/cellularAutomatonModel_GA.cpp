@@ -4,6 +4,9 @@ CellularAutomatonModel_GA::CellularAutomatonModel_GA() {
 	assert(mFloorField.mExits.size() > 1); // it is meaningless to run GA when the number of exits is 1
 
 	read("./data/config_GA.txt");
+	claimIsland();
+	std::seed_seq seq{ mRandomSeed, (unsigned int)mIslandID }; // islands share the crowd and the evaluation seeds, but not their initial chromosomes
+	mRNG_init.seed(seq);
 	std::for_each(mPopulation.begin(), mPopulation.end(), [=](Genome &i) { i.mGenes.resize(mBlocksDim[0] * mBlocksDim[1]); });
 	mHasConverged = false;
 
@@ -20,22 +23,36 @@ CellularAutomatonModel_GA::CellularAutomatonModel_GA() {
 
 	mExitColors.resize(mFloorField.mExits.size());
 	assignExitColors();
+	setExitCells();
+	setExitRankings();
 
 	initPopulation();
 }
 
+CellularAutomatonModel_GA::~CellularAutomatonModel_GA() {
+	delete mGA;
+
+	if (mNumIslands > 1) // release the island
+		std::remove(getIslandFileName(mIslandID, ".lock").c_str());
+}
+
 void CellularAutomatonModel_GA::update() {
 	if (mFlgUpdateStatic || mFlgAgentEdited) {
 		if (mFlgUpdateStatic)
-			mFloorField.update(mAgentManager.mAgents, true);
+			mFloorField.update_p(UPDATE_STATIC);
 		mFlgUpdateStatic = mFlgAgentEdited = false;
 		reset();
 	}
 
-	if (!mHasConverged)
+	if (!mHasConverged) {
 		GAStep();
+		if (mHasConverged) {
+			savePlan();
+			system("pause");
+		}
+	}
 	else {
-		if (mAgentManager.mAgents.size() == 0)
+		if (mAgentManager.mActiveAgents.empty())
 			return;
 
 		std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now(); // start the timer
@@ -45,11 +62,48 @@ void CellularAutomatonModel_GA::update() {
 		std::chrono::duration<double> time = std::chrono::system_clock::now() - start; // stop the timer
 		mElapsedTime += time.count();
 
-		cout << "Timestep " << mTimesteps << ": " << mAgentManager.mAgents.size() << " agent(s) having not left (" << mElapsedTime << "s)" << endl;
+		printf("Timestep %4d: %4d agent(s) having not left (%fs)\n", mTimesteps, mAgentManager.mActiveAgents.size(), mElapsedTime);
+	}
+}
+
+void CellularAutomatonModel_GA::optimize() {
+	while (!mHasConverged) {
+		GAStep();
+		if (!mHasConverged)
+			printf("Generation %4d: best fitness = %f (%fs)\n", mGA->mNumGenerations, mLastBestFitness, mElapsedTime);
+	}
+	savePlan();
+}
+
+void CellularAutomatonModel_GA::savePlan() const {
+	time_t rawTime;
+	struct tm timeInfo;
+	char buffer[15];
+	time(&rawTime);
+	localtime_s(&timeInfo, &rawTime);
+	strftime(buffer, 15, "%y%m%d%H%M%S", &timeInfo);
+
+	std::ofstream ofs("./data/evacuation_plan_" + std::string(buffer) + ".txt", std::ios::out);
+	ofs << "DIM              " << mFloorField.mDim[0] << " " << mFloorField.mDim[1] << endl;
+	ofs << "BLOCK_DIM        " << mBlocksDim[0] << " " << mBlocksDim[1] << endl;
+	ofs << "FITNESS          " << mLastBestFitness << endl;
+	for (size_t i = 0; i < mFloorField.mExits.size(); i++) { // exit ID, number of cells, and the coordinates of every cell
+		ofs << "EXIT             " << i << " " << mFloorField.mExits[i].mPos.size();
+		for (const auto &e : mFloorField.mExits[i].mPos)
+			ofs << " " << e[0] << " " << e[1];
+		ofs << endl;
+	}
+	ofs << "PLAN" << endl; // exit ID of every block, from the bottom row to the top row
+	for (int y = 0; y < mBlocksDim[1]; y++) {
+		for (int x = 0; x < mBlocksDim[0]; x++)
+			ofs << mEvacPlan[y * mBlocksDim[0] + x] << (x == mBlocksDim[0] - 1 ? "" : " ");
+		ofs << endl;
 	}
+	ofs.close();
+	cout << "Save successfully: " << "./data/evacuation_plan_" + std::string(buffer) + ".txt" << endl;
 }
 
-void CellularAutomatonModel_GA::save() {
+void CellularAutomatonModel_GA::save() const {
 	time_t rawTime;
 	struct tm timeInfo;
 	char buffer[15];
@@ -64,6 +118,12 @@ void CellularAutomatonModel_GA::save() {
 	ofs << "MUTATION_RATE    " << mGA->mMutationRate << endl;
 	ofs << "NUM_ELITES       " << mGA->mNumElites << endl;
 	ofs << "NUM_COPIES_ELITE " << mGA->mNumCopiesElite << endl;
+	ofs << "NUM_REPLICAS     " << mNumReplicas << endl;
+	ofs << "NUM_ISLANDS      " << mNumIslands << endl;
+	ofs << "MIGRATION        " << mMigrationInterval << " " << mNumMigrants << endl;
+	ofs << "TOPOLOGY         " << (mTopology == TOPOLOGY_RING ? "RING" : "FULL") << endl;
+	ofs << "ISLAND_DIR       " << mIslandDir << endl;
+	ofs << "RANDOM_SEED      " << mRandomSeed << endl;
 	ofs << "TERMINATION      " << mTerminationCount << " " << mImprovementThresh << endl;
 	ofs.close();
 	cout << "Save successfully: " << "./data/config_GA_saved_" + std::string(buffer) + ".txt" << endl;
@@ -71,114 +131,34 @@ void CellularAutomatonModel_GA::save() {
 	CellularAutomatonModel::save();
 }
 
-void CellularAutomatonModel_GA::draw() {
-	/*
-	 * Draw cells.
-	 */
-	for (int y = 0; y < mFloorField.mDim[1]; y++) {
-		for (int x = 0; x < mFloorField.mDim[0]; x++) {
-			glColor3f(1.0, 1.0, 1.0);
-
-			glBegin(GL_QUADS);
-			glVertex3f(mFloorField.mCellSize[0] * x, mFloorField.mCellSize[1] * y, 0.0);
-			glVertex3f(mFloorField.mCellSize[0] * (x + 1), mFloorField.mCellSize[1] * y, 0.0);
-			glVertex3f(mFloorField.mCellSize[0] * (x + 1), mFloorField.mCellSize[1] * (y + 1), 0.0);
-			glVertex3f(mFloorField.mCellSize[0] * x, mFloorField.mCellSize[1] * (y + 1), 0.0);
-			glEnd();
-		}
-	}
+void CellularAutomatonModel_GA::draw() const {
+	mFloorField.draw();
 
 	/*
-	 * Draw obstacles.
+	 * Draw exits with their colors.
 	 */
-	for (const auto &obstacle : mFloorField.mObstacles) {
-		if (obstacle.mMovable)
-			glColor3f(0.8f, 0.8f, 0.8f);
-		else
-			glColor3f(0.3f, 0.3f, 0.3f);
-
-		glBegin(GL_QUADS);
-		glVertex3f(mFloorField.mCellSize[0] * obstacle.mPos[0], mFloorField.mCellSize[1] * obstacle.mPos[1], 0.0);
-		glVertex3f(mFloorField.mCellSize[0] * (obstacle.mPos[0] + 1), mFloorField.mCellSize[1] * obstacle.mPos[1], 0.0);
-		glVertex3f(mFloorField.mCellSize[0] * (obstacle.mPos[0] + 1), mFloorField.mCellSize[1] * (obstacle.mPos[1] + 1), 0.0);
-		glVertex3f(mFloorField.mCellSize[0] * obstacle.mPos[0], mFloorField.mCellSize[1] * (obstacle.mPos[1] + 1), 0.0);
-		glEnd();
+	for (size_t i = 0; i < mFloorField.mExits.size(); i++) {
+		glColor3fv(mExitColors[i].data());
+		for (const auto &e : mFloorField.mExits[i].mPos)
+			drawSquare((float)e[0], (float)e[1], mFloorField.mCellSize);
 	}
 
 	/*
-	 * Draw exits.
+	 * Draw agents with the colors of their exits.
 	 */
-	if (mFloorField.mFlgEnableColormap) {
-		for (size_t i = 0; i < mFloorField.mExits.size(); i++) {
-			glColor3fv(mExitColors[i].data());
-			for (const auto &e : mFloorField.mExits[i]) {
-				glBegin(GL_QUADS);
-				glVertex3f(mFloorField.mCellSize[0] * e[0], mFloorField.mCellSize[1] * e[1], 0.0);
-				glVertex3f(mFloorField.mCellSize[0] * (e[0] + 1), mFloorField.mCellSize[1] * e[1], 0.0);
-				glVertex3f(mFloorField.mCellSize[0] * (e[0] + 1), mFloorField.mCellSize[1] * (e[1] + 1), 0.0);
-				glVertex3f(mFloorField.mCellSize[0] * e[0], mFloorField.mCellSize[1] * (e[1] + 1), 0.0);
-				glEnd();
-			}
-		}
-	}
-	else {
-		glLineWidth(1.0);
-		glColor3f(0.0, 0.0, 0.0);
-
-		for (const auto &exit : mFloorField.mExits) {
-			for (const auto &e : exit) {
-				glBegin(GL_LINE_STRIP);
-				glVertex3f(mFloorField.mCellSize[0] * e[0], mFloorField.mCellSize[1] * e[1], 0.0);
-				glVertex3f(mFloorField.mCellSize[0] * e[0], mFloorField.mCellSize[1] * (e[1] + 1), 0.0);
-				glVertex3f(mFloorField.mCellSize[0] * (e[0] + 1), mFloorField.mCellSize[1] * e[1], 0.0);
-				glVertex3f(mFloorField.mCellSize[0] * (e[0] + 1), mFloorField.mCellSize[1] * (e[1] + 1), 0.0);
-				glEnd();
-				glBegin(GL_LINE_STRIP);
-				glVertex3f(mFloorField.mCellSize[0] * e[0], mFloorField.mCellSize[1] * (e[1] + 1), 0.0);
-				glVertex3f(mFloorField.mCellSize[0] * (e[0] + 1), mFloorField.mCellSize[1] * (e[1] + 1), 0.0);
-				glVertex3f(mFloorField.mCellSize[0] * e[0], mFloorField.mCellSize[1] * e[1], 0.0);
-				glVertex3f(mFloorField.mCellSize[0] * (e[0] + 1), mFloorField.mCellSize[1] * e[1], 0.0);
-				glEnd();
-			}
-		}
-	}
+	for (const auto &i : mAgentManager.mActiveAgents) {
+		const Agent &agent = mAgentManager.mPool[i];
+		float agentSize = mAgentManager.mAgentSize;
 
-	/*
-	 * Draw the grid.
-	 */
-	if (mFloorField.mFlgShowGrid) {
-		glLineWidth(1.0);
-		glColor3f(0.5, 0.5, 0.5);
-
-		glBegin(GL_LINES);
-		for (int i = 0; i <= mFloorField.mDim[0]; i++) {
-			glVertex3f(mFloorField.mCellSize[0] * i, 0.0, 0.0);
-			glVertex3f(mFloorField.mCellSize[0] * i, mFloorField.mCellSize[1] * mFloorField.mDim[1], 0.0);
-		}
-		for (int i = 0; i <= mFloorField.mDim[1]; i++) {
-			glVertex3f(0.0, mFloorField.mCellSize[1] * i, 0.0);
-			glVertex3f(mFloorField.mCellSize[0] * mFloorField.mDim[0], mFloorField.mCellSize[1] * i, 0.0);
-		}
-		glEnd();
-	}
-
-	/*
-	 * Draw agents.
-	 */
-	for (size_t i = 0; i < mAgentManager.mAgents.size(); i++) {
-		Agent agent = mAgentManager.mAgents[i];
-
-		if (mAgentManager.mFlgEnableColormap && !mHasConverged) // before GA converges
+		if (!mHasConverged) // before GA converges
 			glColor3fv(mExitColors[mEvacPlan[mBlocks[convertTo1D(agent.mPos)]]].data());
-		else if (mAgentManager.mFlgEnableColormap && mHasConverged) // after GA converges
+		else // after GA converges
 			glColor3fv(mExitColors[mAgentGoals[i]].data());
-		else
-			glColor3f(1.0, 1.0, 1.0);
-		drawFilledCircle(mAgentManager.mAgentSize * agent.mPos[0] + mAgentManager.mAgentSize / 2, mAgentManager.mAgentSize * agent.mPos[1] + mAgentManager.mAgentSize / 2, mAgentManager.mAgentSize / 2.5f, 10);
+		drawFilledCircle(agentSize * agent.mPos[0] + agentSize / 2.f, agentSize * agent.mPos[1] + agentSize / 2.f, agentSize / 2.5f, 10);
 
-		glLineWidth(1.0);
-		glColor3f(0.0, 0.0, 0.0);
-		drawCircle(mAgentManager.mAgentSize * agent.mPos[0] + mAgentManager.mAgentSize / 2, mAgentManager.mAgentSize * agent.mPos[1] + mAgentManager.mAgentSize / 2, mAgentManager.mAgentSize / 2.5f, 10);
+		glLineWidth(1.f);
+		glColor3f(0.f, 0.f, 0.f);
+		drawCircle(agentSize * agent.mPos[0] + agentSize / 2.f, agentSize * agent.mPos[1] + agentSize / 2.f, agentSize / 2.5f, 10);
 	}
 }
 
@@ -188,6 +168,14 @@ void CellularAutomatonModel_GA::read(const char *fileName) {
 
 	double crossoverRate, mutationRate;
 	int numElites, numCopiesElite;
+	mImprovementThresh = 0.0;
+	mNumReplicas = 3;
+	mNumIslands = 1;
+	mMigrationInterval = 10;
+	mNumMigrants = 2;
+	mTopology = TOPOLOGY_RING;
+	mIslandDir = "./data/";
+	long long randomSeed = -1;
 	std::string key;
 	while (ifs >> key) {
 		if (key.compare("POPULATION") == 0) {
@@ -207,6 +195,35 @@ void CellularAutomatonModel_GA::read(const char *fileName) {
 			ifs >> numCopiesElite;
 		else if (key.compare("TERMINATION") == 0)
 			ifs >> mTerminationCount >> mImprovementThresh;
+		else if (key.compare("NUM_REPLICAS") == 0)
+			ifs >> mNumReplicas;
+		else if (key.compare("NUM_ISLANDS") == 0)
+			ifs >> mNumIslands;
+		else if (key.compare("MIGRATION") == 0)
+			ifs >> mMigrationInterval >> mNumMigrants;
+		else if (key.compare("TOPOLOGY") == 0) {
+			std::string topology;
+			ifs >> topology;
+			mTopology = topology.compare("FULL") == 0 ? TOPOLOGY_FULL : TOPOLOGY_RING;
+		}
+		else if (key.compare("ISLAND_DIR") == 0)
+			ifs >> mIslandDir;
+		else if (key.compare("RANDOM_SEED") == 0)
+			ifs >> randomSeed;
+	}
+
+	/*
+	 * Regenerate the agents from RANDOM_SEED, so that every island evolves plans for the same crowd and evaluates them with the same seeds.
+	 */
+	if (randomSeed != -1) {
+		mRandomSeed = (unsigned int)randomSeed;
+		mRNG.seed(mRandomSeed);
+		if (mFlgAgentGenerated)
+			regenerateAgents();
+	}
+	else if (mNumIslands > 1 && mFlgAgentGenerated) {
+		cout << "Islands need RANDOM_SEED to share generated agents, running without migration" << endl;
+		mNumIslands = 1;
 	}
 
 	mGA = new GeneticAlgorithm(mPopulation.size(), mBlocksDim[0] * mBlocksDim[1]);
@@ -219,7 +236,7 @@ void CellularAutomatonModel_GA::read(const char *fileName) {
 	ifs.close();
 }
 
-void CellularAutomatonModel_GA::print() {
+void CellularAutomatonModel_GA::print() const {
 	for (int y = mFloorField.mDim[1] - 1; y >= 0; y--) {
 		for (int x = 0; x < mFloorField.mDim[0]; x++)
 			printf("%2d ", mBlocks[convertTo1D(x, y)]);
@@ -234,6 +251,9 @@ void CellularAutomatonModel_GA::reset() {
 	mExitColors.resize(mFloorField.mExits.size());
 	assignExitColors();
 
+	setCellStates();
+	setExitCells();
+	setExitRankings();
 	initPopulation();
 
 	mElapsedTime = 0.0;
@@ -261,40 +281,72 @@ void CellularAutomatonModel_GA::assignExitColors() {
 		mExitColors[i][2] = (colorCode[i] + 0.5f) / numExits;
 }
 
+void CellularAutomatonModel_GA::setExitCells() {
+	mIsExitCell.assign(mFloorField.mDim[0] * mFloorField.mDim[1], false);
+	for (const auto &exit : mFloorField.mExits) {
+		for (const auto &e : exit.mPos)
+			mIsExitCell[convertTo1D(e)] = true;
+	}
+}
+
+void CellularAutomatonModel_GA::setExitRankings() {
+	/*
+	 * Rank the exits for every block by the average static floor field over the walkable cells of the block, i.e., the distance its agents actually have to walk.
+	 *  Exit cells are skipped, since other exits are obstacles (OBSTACLE_WEIGHT) in the field of every exit. Cells an exit cannot be reached from keep INIT_WEIGHT,
+	 *  so that every exit is averaged over the same cells and unreachability is penalized. All blocks are handled in one pass over the cells for each exit.
+	 */
+	int numBlocks = mBlocksDim[0] * mBlocksDim[1];
+	int numExits = mFloorField.mExits.size();
+	arrayNi numCells(numBlocks, 0);
+	for (size_t i = 0; i < mCellStates.size(); i++) {
+		if (mCellStates[i] != TYPE_MOVABLE_OBSTACLE && mCellStates[i] != TYPE_IMMOVABLE_OBSTACLE && !mIsExitCell[i])
+			numCells[mBlocks[i]]++;
+	}
+
+	std::vector<double> dists(numBlocks * numExits, 0.0); // use [block ID * numExits + exit ID] to access elements
+	for (int j = 0; j < numExits; j++) {
+		const arrayNf &cells = mFloorField.getCellsForExitStatic(j);
+		for (size_t i = 0; i < mCellStates.size(); i++) {
+			if (mCellStates[i] != TYPE_MOVABLE_OBSTACLE && mCellStates[i] != TYPE_IMMOVABLE_OBSTACLE && !mIsExitCell[i])
+				dists[mBlocks[i] * numExits + j] += cells[i];
+		}
+	}
+
+	mExitRankings.resize(numBlocks);
+	for (int i = 0; i < numBlocks; i++) {
+		mExitRankings[i].resize(numExits);
+		std::iota(mExitRankings[i].begin(), mExitRankings[i].end(), 0);
+		if (numCells[i] == 0) // the block is fully occupied by obstacles and exits
+			continue;
+		const double *blockDists = &dists[i * numExits];
+		std::stable_sort(mExitRankings[i].begin(), mExitRankings[i].end(), [&](int lhs, int rhs) { return blockDists[lhs] < blockDists[rhs]; });
+	}
+}
+
 void CellularAutomatonModel_GA::initPopulation() {
 	cout << "Initializing the population... ";
 	std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now(); // start the timer
 
+	/*
+	 * Draw the seeds shared by all evaluations. The cached fitness stays valid as long as they are unchanged.
+	 */
+	mSeeds.resize(mNumReplicas);
+	for (auto &seed : mSeeds)
+		seed = mRNG();
+	mFitnessCache.clear();
+
 	/*
 	 * Set the chromosomes.
 	 */
-	std::uniform_int_distribution<> distribution(0, 2);
+	std::uniform_int_distribution<> distribution(0, std::min(2, (int)mFloorField.mExits.size() - 1));
 	for (int i = 0; i < mBlocksDim[0] * mBlocksDim[1]; i++) { // loop through every gene
-		int center_x = 0, center_y = 0;
-		int count = 0;
-		for (int y = 0; y < mFloorField.mDim[1]; y++) {
-			for (int x = 0; x < mFloorField.mDim[0]; x++) {
-				if (i == mBlocks[convertTo1D(x, y)]) {
-					center_x += x;
-					center_y += y;
-					count++;
-				}
-			}
-		}
-		array2f center{ (float)center_x / count, (float)center_y / count }; // calculate the center of block i
-
-		std::vector<std::pair<int, double>> buffer;
-		for (size_t j = 0; j < mFloorField.mExits.size(); j++) { // calculate the distance between block i and every exit
-			array2i middle = mFloorField.mExits[j][mFloorField.mExits[j].size() / 2];
-			buffer.push_back(std::pair<int, double>(j, sqrt((center[0] - middle[0]) * (center[0] - middle[0]) + (center[1] - middle[1]) * (center[1] - middle[1]))));
+		for (auto &chromosome : mPopulation) { // randomly select one of the three closest exits as gene i
+			chromosome.mGenes[i] = mExitRankings[i][distribution(mRNG_init)];
+			chromosome.mFitness = 0.0;
 		}
-		std::sort(buffer.begin(), buffer.end(), [](const std::pair<int, double> &lhs, const std::pair<int, double> &rhs) { return lhs.second < rhs.second; });
-
-		for (auto &chromosome : mPopulation) // randomly select one of the three closest exits as gene i
-			chromosome.mGenes[i] = buffer[distribution(mRNG)].first;
 	}
 
-	evaluatePopulation();
+	evaluatePopulation_tbb();
 
 	Genome best = *std::max_element(mPopulation.begin(), mPopulation.end(), [](const Genome &lhs, const Genome &rhs) { return lhs.mFitness < rhs.mFitness; });
 	mEvacPlan = best.mGenes;
@@ -306,48 +358,96 @@ void CellularAutomatonModel_GA::initPopulation() {
 }
 
 void CellularAutomatonModel_GA::evaluatePopulation() {
-	std::vector<Agent> agents;
-	arrayNb isAlive;
-	int numAliveAgents;
 	for (auto &chromosome : mPopulation) {
 		if (chromosome.mFitness > 0.0)
 			continue;
 
-		chromosome.mFitness = 0.0;
-		for (int i = 0; i < 3; i++) { // run GA 3 times and take an average
-			/*
-			 * Initialize the simulation.
-			 */
-			agents = mAgentManager.mAgents;
-			isAlive.assign(mAgentManager.mAgents.size(), true);
-			numAliveAgents = mAgentManager.mAgents.size();
-			generateGoalsFromPlan(chromosome.mGenes); // assign an exit to every agent
-			setCellStates();
-
-			/*
-			 * Evaluate the chromosome.
-			 *  Set fitness = 1.0 / (mTotalTimesteps / mAgentManager.mAgents.size()) to minimize average evacuation time, or fitness = 1.0 / mTotalTimesteps to minimize total evacuation time.
-			 */
-			mTimesteps = mTotalTimesteps = 0;
-			while (numAliveAgents > 0)
-				simStep_GA(agents, isAlive, numAliveAgents);
-			chromosome.mFitness += 1.0 / (mTotalTimesteps / mAgentManager.mAgents.size());
+		auto cached = mFitnessCache.find(chromosome.mGenes);
+		if (cached != mFitnessCache.end()) {
+			chromosome.mFitness = cached->second;
+			continue;
+		}
+
+		for (const auto &seed : mSeeds) // run the simulation mNumReplicas times and take an average
+			chromosome.mFitness += evaluate(chromosome.mGenes, seed);
+		chromosome.mFitness /= mNumReplicas;
+		mFitnessCache[chromosome.mGenes] = chromosome.mFitness;
+	}
+}
+
+double CellularAutomatonModel_GA::evaluate(const arrayNi &plan, unsigned int seed, double cutoff) const {
+	Simulation_GA sim;
+	return evaluate(plan, seed, cutoff, sim);
+}
+
+double CellularAutomatonModel_GA::evaluate(const arrayNi &plan, unsigned int seed, double cutoff, Simulation_GA &sim) const {
+	/*
+	 * Initialize the simulation (the storage of sim is reused).
+	 */
+	int numAgents = mAgentManager.mActiveAgents.size();
+	sim.mCells.resize(numAgents);
+	sim.mGoals.resize(numAgents);
+	for (int i = 0; i < numAgents; i++) {
+		sim.mCells[i] = convertTo1D(mAgentManager.mPool[mAgentManager.mActiveAgents[i]].mPos);
+		sim.mGoals[i] = plan[mBlocks[sim.mCells[i]]]; // assign an exit to every agent
+	}
+	sim.mIsAlive.assign(numAgents, true);
+	sim.mCellStates.assign(mCellStates.begin(), mCellStates.end());
+	sim.mOrder.resize(numAgents);
+	sim.mNumAliveAgents = numAgents;
+	sim.mTimesteps = sim.mTotalTimesteps = 0;
+	sim.mRNG.seed(seed);
+
+	/*
+	 * Evaluate the chromosome.
+	 *  Set fitness = 1.0 / (mTotalTimesteps / number of agents) to minimize average evacuation time, or fitness = 1.0 / mTotalTimesteps to minimize total evacuation time.
+	 *  Agents having not left cannot leave before the current timestep, so the fitness is bounded from above during the simulation.
+	 */
+	int minTotalTimesteps = cutoff > 0.0 ? getMinTotalTimesteps(plan) : 0;
+	while (sim.mNumAliveAgents > 0) {
+		simStep_GA(sim);
+
+		if (cutoff > 0.0) {
+			double maxFitness = 1.0 / ((double)std::max(minTotalTimesteps, sim.mTotalTimesteps + sim.mNumAliveAgents * sim.mTimesteps) / numAgents);
+			if (maxFitness < cutoff) // the chromosome is hopeless
+				return maxFitness;
 		}
-		chromosome.mFitness /= 3;
 	}
+	return 1.0 / ((double)sim.mTotalTimesteps / numAgents);
+}
+
+double CellularAutomatonModel_GA::getMaxFitness(const arrayNi &plan) const {
+	return 1.0 / ((double)getMinTotalTimesteps(plan) / mAgentManager.mActiveAgents.size());
+}
+
+int CellularAutomatonModel_GA::getMinTotalTimesteps(const arrayNi &plan) const {
+	/*
+	 * An agent moves at most one cell (diagonal included) per timestep, so it takes at least the Chebyshev distance to the closest cell of its exit.
+	 */
+	int minTotalTimesteps = 0;
+	for (const auto &i : mAgentManager.mActiveAgents) {
+		const array2i &pos = mAgentManager.mPool[i].mPos;
+		int minDist = INT_MAX;
+		for (const auto &e : mFloorField.mExits[plan[mBlocks[convertTo1D(pos)]]].mPos)
+			minDist = std::min(minDist, std::max(abs(pos[0] - e[0]), abs(pos[1] - e[1])));
+		minTotalTimesteps += minDist;
+	}
+	return minTotalTimesteps;
 }
 
 void CellularAutomatonModel_GA::generateGoalsFromPlan(const arrayNi &plan) {
-	mAgentGoals.resize(mAgentManager.mAgents.size());
-	for (size_t i = 0; i < mAgentManager.mAgents.size(); i++)
-		mAgentGoals[i] = plan[mBlocks[convertTo1D(mAgentManager.mAgents[i].mPos)]];
+	mAgentGoals.assign(mAgentManager.mPool.size(), STATE_NULL);
+	for (const auto &i : mAgentManager.mActiveAgents)
+		mAgentGoals[i] = plan[mBlocks[convertTo1D(mAgentManager.mPool[i].mPos)]];
 }
 
 void CellularAutomatonModel_GA::GAStep() {
 	std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now(); // start the timer
 
 	mPopulation = mGA->epoch(mPopulation);
-	evaluatePopulation();
+	evaluatePopulation_tbb();
+	if (mNumIslands > 1 && mGA->mNumGenerations % mMigrationInterval == 0)
+		migrate();
 
 	std::chrono::duration<double> time = std::chrono::system_clock::now() - start; // stop the timer
 	mElapsedTime += time.count();
@@ -366,56 +466,124 @@ void CellularAutomatonModel_GA::GAStep() {
 	if (mUnchangedBestCount == mTerminationCount) {
 		mHasConverged = true;
 		cout << "GA converged after " << mGA->mNumGenerations << " generations with the best fitness = " << mLastBestFitness << " (" << mElapsedTime << "s)" << endl;
-		system("pause");
 
 		// prepare for the regular simulation
 		generateGoalsFromPlan(mEvacPlan);
 		setCellStates();
-		mTimesteps = 0;
+		mTimesteps = mTotalTimesteps = 0;
 		mElapsedTime = 0.0;
 	}
 	else
 		mLastBestFitness = best.mFitness;
 }
 
-void CellularAutomatonModel_GA::simStep_GA(std::vector<Agent> &agents, arrayNb &isAlive, int &numAliveAgents) {
+void CellularAutomatonModel_GA::claimIsland() {
+	mIslandID = 0;
+	if (mNumIslands <= 1)
+		return;
+
 	/*
-	 * Check whether the agent arrives at any exit.
+	 * Claim the first free island by creating its lock file exclusively, so that several copies of the program can be launched with the same configuration.
+	 *  Lock files left by a crashed process have to be deleted manually.
 	 */
-	for (size_t i = 0; i < isAlive.size(); i++) {
-		if (!isAlive[i])
-			continue;
-		for (const auto &exit : mFloorField.mExits) {
-			for (const auto &e : exit) {
-				if (agents[i].mPos == e) {
-					mCellStates[convertTo1D(agents[i].mPos)] = TYPE_EMPTY;
-					isAlive[i] = false;
-					numAliveAgents--;
-					mTotalTimesteps += mTimesteps;
-					goto stop;
-				}
-			}
+	for (int i = 0; i < mNumIslands; i++) {
+		FILE *fp;
+		if (fopen_s(&fp, getIslandFileName(i, ".lock").c_str(), "wx") == 0) {
+			fclose(fp);
+			mIslandID = i;
+			mLastImported.assign(mNumIslands, 0);
+			std::remove(getIslandFileName(mIslandID, "_migrants.txt").c_str()); // left by a previous run
+			cout << "Running as island " << mIslandID << " of " << mNumIslands << endl;
+			return;
 		}
+	}
+
+	cout << "No free island in " << mIslandDir << ", running without migration" << endl;
+	mNumIslands = 1;
+}
 
-		stop: ;
+void CellularAutomatonModel_GA::migrate() {
+	/*
+	 * Emigration.
+	 *  Publish the best chromosomes. The file is written under a temporary name and renamed, so other islands never read a partial file.
+	 */
+	arrayNi order(mPopulation.size());
+	std::iota(order.begin(), order.end(), 0);
+	int numMigrants = std::min(mNumMigrants, (int)mPopulation.size());
+	std::partial_sort(order.begin(), order.begin() + numMigrants, order.end(), [&](int lhs, int rhs) { return mPopulation[lhs].mFitness > mPopulation[rhs].mFitness; });
+
+	std::string fileName = getIslandFileName(mIslandID, "_migrants.txt");
+	std::ofstream ofs(fileName + ".tmp", std::ios::out);
+	ofs << mGA->mNumGenerations << " " << numMigrants << endl;
+	for (int i = 0; i < numMigrants; i++) {
+		for (const auto &gene : mPopulation[order[i]].mGenes)
+			ofs << gene << " ";
+		ofs << endl;
 	}
-	mTimesteps++;
-	if (numAliveAgents == 0) // all agents have left
+	ofs.close();
+	std::remove(fileName.c_str());
+	std::rename((fileName + ".tmp").c_str(), fileName.c_str());
+
+	/*
+	 * Immigration.
+	 *  Take the newest migrants of the source islands, and let them replace the worst chromosomes.
+	 */
+	std::vector<arrayNi> immigrants;
+	for (int i = 0; i < mNumIslands; i++) {
+		if (i == mIslandID || (mTopology == TOPOLOGY_RING && i != (mIslandID + mNumIslands - 1) % mNumIslands))
+			continue;
+
+		std::ifstream ifs(getIslandFileName(i, "_migrants.txt"), std::ios::in);
+		int generation, num;
+		if (!(ifs >> generation >> num) || generation <= mLastImported[i])
+			continue;
+		mLastImported[i] = generation;
+
+		for (int j = 0; j < num; j++) {
+			arrayNi genes(mBlocksDim[0] * mBlocksDim[1]);
+			for (auto &gene : genes)
+				ifs >> gene;
+			if (ifs && std::all_of(genes.begin(), genes.end(), [&](int gene) { return gene >= 0 && gene <= mGA->mMaxGeneValue; }))
+				immigrants.push_back(genes);
+		}
+	}
+	if (immigrants.empty())
 		return;
 
-	std::uniform_real_distribution<> distribution(0.0, 1.0);
+	int numImmigrants = std::min((int)immigrants.size(), (int)mPopulation.size() / 2);
+	std::partial_sort(order.begin(), order.begin() + numImmigrants, order.end(), [&](int lhs, int rhs) { return mPopulation[lhs].mFitness < mPopulation[rhs].mFitness; });
+	for (int i = 0; i < numImmigrants; i++)
+		mPopulation[order[i]] = Genome(immigrants[i], 0.0); // immigrants are re-evaluated with the seeds of this island
+
+	evaluatePopulation_tbb();
+	cout << "Island " << mIslandID << ": " << numImmigrants << " immigrant(s) at generation " << mGA->mNumGenerations << endl;
+}
+
+void CellularAutomatonModel_GA::simStep_GA(Simulation_GA &sim) const {
+	/*
+	 * Check whether the agent arrives at any exit.
+	 */
+	for (size_t i = 0; i < sim.mCells.size(); i++) {
+		if (sim.mIsAlive[i] && mIsExitCell[sim.mCells[i]]) {
+			sim.mCellStates[sim.mCells[i]] = TYPE_EMPTY;
+			sim.mIsAlive[i] = false;
+			sim.mNumAliveAgents--;
+			sim.mTotalTimesteps += sim.mTimesteps;
+		}
+	}
+	sim.mTimesteps++;
+	if (sim.mNumAliveAgents == 0) // all agents have left
+		return;
 
 	/*
 	 * Handle agent movement.
 	 */
-	arrayNi updatingOrder;
-	for (size_t i = 0; i < agents.size(); i++)
-		updatingOrder.push_back(i);
-	std::shuffle(updatingOrder.begin(), updatingOrder.end(), mRNG); // randomly generate the updating order
+	std::iota(sim.mOrder.begin(), sim.mOrder.end(), 0);
+	std::shuffle(sim.mOrder.begin(), sim.mOrder.end(), sim.mRNG); // randomly generate the updating order
 
-	for (const auto &i : updatingOrder) {
-		if (isAlive[i])
-			moveAgents(agents[i], mAgentGoals[i], distribution);
+	for (const auto &i : sim.mOrder) {
+		if (sim.mIsAlive[i])
+			moveAgent(sim.mCells[i], sim.mGoals[i], sim.mCellStates, sim.mRNG);
 	}
 }
 
@@ -423,161 +591,70 @@ void CellularAutomatonModel_GA::simStep() {
 	/*
 	 * Check whether the agent arrives at any exit.
 	 */
-	arrayNi::iterator j = mAgentGoals.begin();
-	for (std::vector<Agent>::iterator i = mAgentManager.mAgents.begin(); i != mAgentManager.mAgents.end() && j != mAgentGoals.end();) {
-		bool updated = false;
-		for (const auto &exit : mFloorField.mExits) {
-			for (const auto &e : exit) {
-				if ((*i).mPos == e) {
-					mCellStates[convertTo1D((*i).mPos)] = TYPE_EMPTY;
-					i = mAgentManager.mAgents.erase(i);
-					j = mAgentGoals.erase(j);
-					mTotalTimesteps += mTimesteps;
-					updated = true;
-					goto stop;
-				}
-			}
+	for (size_t i = 0; i < mAgentManager.mActiveAgents.size();) {
+		int curIndex = convertTo1D(mAgentManager.mPool[mAgentManager.mActiveAgents[i]].mPos);
+		if (mIsExitCell[curIndex]) {
+			mCellStates[curIndex] = TYPE_EMPTY;
+			mAgentManager.deleteAgent(i);
+			mTotalTimesteps += mTimesteps;
 		}
-
-		stop:
-		if (i == mAgentManager.mAgents.end() && j == mAgentGoals.end()) // all agents have left
-			break;
-		if (!updated) {
+		else
 			i++;
-			j++;
-		}
 	}
 	mTimesteps++;
 
-	std::uniform_real_distribution<> distribution(0.0, 1.0);
-
 	/*
 	 * Handle agent movement.
 	 */
-	arrayNi updatingOrder;
-	for (size_t i = 0; i < mAgentManager.mAgents.size(); i++)
-		updatingOrder.push_back(i);
+	arrayNi updatingOrder = mAgentManager.mActiveAgents;
 	std::shuffle(updatingOrder.begin(), updatingOrder.end(), mRNG); // randomly generate the updating order
 
 	for (const auto &i : updatingOrder) {
-		if (distribution(mRNG) > mAgentManager.mPanicProb)
-			moveAgents(mAgentManager.mAgents[i], mAgentGoals[i], distribution);
+		if (mDistribution(mRNG) > mAgentManager.mPanicProb) {
+			int cell = convertTo1D(mAgentManager.mPool[i].mPos);
+			moveAgent(cell, mAgentGoals[i], mCellStates, mRNG);
+			mAgentManager.mPool[i].mPos = array2i{ cell % mFloorField.mDim[0], cell / mFloorField.mDim[0] };
+		}
 	}
 }
 
-void CellularAutomatonModel_GA::moveAgents(Agent &agent, int goal, std::uniform_real_distribution<> &distribution) {
-	array2i dim = mFloorField.mDim;
-	int curIndex = convertTo1D(agent.mPos), adjIndex;
+void CellularAutomatonModel_GA::moveAgent(int &cell, int goal, arrayNi &cellStates, std::mt19937 &rng) const {
+	static const int offsets[8][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }, { 1, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 } }; // right, left, up, down, upper right, lower left, lower right, upper left
+
+	const arrayNf &cells = mFloorField.getCellsForExitStatic(goal);
+	int x = cell % mFloorField.mDim[0];
+	int y = cell / mFloorField.mDim[0];
 
 	/*
 	 * Find available cells with the lowest cell value.
 	 */
 	double lowestCellValue = OBSTACLE_WEIGHT - 1; // in this case, an agent is allowed to keep away from the exit
-	std::vector<array2i> possibleCoords;
-	possibleCoords.reserve(8);
-
-	// right cell
-	adjIndex = convertTo1D(agent.mPos[0] + 1, agent.mPos[1]);
-	if (agent.mPos[0] + 1 < dim[0] && mCellStates[adjIndex] == TYPE_EMPTY) {
-		if (lowestCellValue == mFloorField.mCellsForExitsStatic[goal][adjIndex] && mFloorField.mCellsForExitsStatic[goal][curIndex] != mFloorField.mCellsForExitsStatic[goal][adjIndex])
-			possibleCoords.push_back(array2i{ agent.mPos[0] + 1, agent.mPos[1] });
-		else if (lowestCellValue > mFloorField.mCellsForExitsStatic[goal][adjIndex]) {
-			lowestCellValue = mFloorField.mCellsForExitsStatic[goal][adjIndex];
-			possibleCoords.clear();
-			possibleCoords.push_back(array2i{ agent.mPos[0] + 1, agent.mPos[1] });
-		}
-	}
+	int possibleCells[8];
+	int numPossibleCells = 0;
 
-	// left cell
-	adjIndex = convertTo1D(agent.mPos[0] - 1, agent.mPos[1]);
-	if (agent.mPos[0] - 1 >= 0 && mCellStates[adjIndex] == TYPE_EMPTY) {
-		if (lowestCellValue == mFloorField.mCellsForExitsStatic[goal][adjIndex] && mFloorField.mCellsForExitsStatic[goal][curIndex] != mFloorField.mCellsForExitsStatic[goal][adjIndex])
-			possibleCoords.push_back(array2i{ agent.mPos[0] - 1, agent.mPos[1] });
-		else if (lowestCellValue > mFloorField.mCellsForExitsStatic[goal][adjIndex]) {
-			lowestCellValue = mFloorField.mCellsForExitsStatic[goal][adjIndex];
-			possibleCoords.clear();
-			possibleCoords.push_back(array2i{ agent.mPos[0] - 1, agent.mPos[1] });
-		}
-	}
-
-	// up cell
-	adjIndex = convertTo1D(agent.mPos[0], agent.mPos[1] + 1);
-	if (agent.mPos[1] + 1 < dim[1] && mCellStates[adjIndex] == TYPE_EMPTY) {
-		if (lowestCellValue == mFloorField.mCellsForExitsStatic[goal][adjIndex] && mFloorField.mCellsForExitsStatic[goal][curIndex] != mFloorField.mCellsForExitsStatic[goal][adjIndex])
-			possibleCoords.push_back(array2i{ agent.mPos[0], agent.mPos[1] + 1 });
-		else if (lowestCellValue > mFloorField.mCellsForExitsStatic[goal][adjIndex]) {
-			lowestCellValue = mFloorField.mCellsForExitsStatic[goal][adjIndex];
-			possibleCoords.clear();
-			possibleCoords.push_back(array2i{ agent.mPos[0], agent.mPos[1] + 1 });
-		}
-	}
-
-	// down cell
-	adjIndex = convertTo1D(agent.mPos[0], agent.mPos[1] - 1);
-	if (agent.mPos[1] - 1 >= 0 && mCellStates[adjIndex] == TYPE_EMPTY) {
-		if (lowestCellValue == mFloorField.mCellsForExitsStatic[goal][adjIndex] && mFloorField.mCellsForExitsStatic[goal][curIndex] != mFloorField.mCellsForExitsStatic[goal][adjIndex])
-			possibleCoords.push_back(array2i{ agent.mPos[0], agent.mPos[1] - 1 });
-		else if (lowestCellValue > mFloorField.mCellsForExitsStatic[goal][adjIndex]) {
-			lowestCellValue = mFloorField.mCellsForExitsStatic[goal][adjIndex];
-			possibleCoords.clear();
-			possibleCoords.push_back(array2i{ agent.mPos[0], agent.mPos[1] - 1 });
-		}
-	}
-
-	// upper right cell
-	adjIndex = convertTo1D(agent.mPos[0] + 1, agent.mPos[1] + 1);
-	if (agent.mPos[0] + 1 < dim[0] && agent.mPos[1] + 1 < dim[1] && mCellStates[adjIndex] == TYPE_EMPTY) {
-		if (lowestCellValue == mFloorField.mCellsForExitsStatic[goal][adjIndex] && mFloorField.mCellsForExitsStatic[goal][curIndex] != mFloorField.mCellsForExitsStatic[goal][adjIndex])
-			possibleCoords.push_back(array2i{ agent.mPos[0] + 1, agent.mPos[1] + 1 });
-		else if (lowestCellValue > mFloorField.mCellsForExitsStatic[goal][adjIndex]) {
-			lowestCellValue = mFloorField.mCellsForExitsStatic[goal][adjIndex];
-			possibleCoords.clear();
-			possibleCoords.push_back(array2i{ agent.mPos[0] + 1, agent.mPos[1] + 1 });
-		}
-	}
-
-	// lower left cell
-	adjIndex = convertTo1D(agent.mPos[0] - 1, agent.mPos[1] - 1);
-	if (agent.mPos[0] - 1 >= 0 && agent.mPos[1] - 1 >= 0 && mCellStates[adjIndex] == TYPE_EMPTY) {
-		if (lowestCellValue == mFloorField.mCellsForExitsStatic[goal][adjIndex] && mFloorField.mCellsForExitsStatic[goal][curIndex] != mFloorField.mCellsForExitsStatic[goal][adjIndex])
-			possibleCoords.push_back(array2i{ agent.mPos[0] - 1, agent.mPos[1] - 1 });
-		else if (lowestCellValue > mFloorField.mCellsForExitsStatic[goal][adjIndex]) {
-			lowestCellValue = mFloorField.mCellsForExitsStatic[goal][adjIndex];
-			possibleCoords.clear();
-			possibleCoords.push_back(array2i{ agent.mPos[0] - 1, agent.mPos[1] - 1 });
-		}
-	}
-
-	// lower right cell
-	adjIndex = convertTo1D(agent.mPos[0] + 1, agent.mPos[1] - 1);
-	if (agent.mPos[0] + 1 < dim[0] && agent.mPos[1] - 1 >= 0 && mCellStates[adjIndex] == TYPE_EMPTY) {
-		if (lowestCellValue == mFloorField.mCellsForExitsStatic[goal][adjIndex] && mFloorField.mCellsForExitsStatic[goal][curIndex] != mFloorField.mCellsForExitsStatic[goal][adjIndex])
-			possibleCoords.push_back(array2i{ agent.mPos[0] + 1, agent.mPos[1] - 1 });
-		else if (lowestCellValue > mFloorField.mCellsForExitsStatic[goal][adjIndex]) {
-			lowestCellValue = mFloorField.mCellsForExitsStatic[goal][adjIndex];
-			possibleCoords.clear();
-			possibleCoords.push_back(array2i{ agent.mPos[0] + 1, agent.mPos[1] - 1 });
-		}
-	}
+	for (const auto &offset : offsets) {
+		if (!isWithinBoundary(x + offset[0], y + offset[1]))
+			continue;
+		int adjIndex = convertTo1D(x + offset[0], y + offset[1]);
+		if (cellStates[adjIndex] != TYPE_EMPTY)
+			continue;
 
-	// upper left cell
-	adjIndex = convertTo1D(agent.mPos[0] - 1, agent.mPos[1] + 1);
-	if (agent.mPos[0] - 1 >= 0 && agent.mPos[1] + 1 < dim[1] && mCellStates[adjIndex] == TYPE_EMPTY) {
-		if (lowestCellValue == mFloorField.mCellsForExitsStatic[goal][adjIndex] && mFloorField.mCellsForExitsStatic[goal][curIndex] != mFloorField.mCellsForExitsStatic[goal][adjIndex])
-			possibleCoords.push_back(array2i{ agent.mPos[0] - 1, agent.mPos[1] + 1 });
-		else if (lowestCellValue > mFloorField.mCellsForExitsStatic[goal][adjIndex]) {
-			lowestCellValue = mFloorField.mCellsForExitsStatic[goal][adjIndex];
-			possibleCoords.clear();
-			possibleCoords.push_back(array2i{ agent.mPos[0] - 1, agent.mPos[1] + 1 });
+		if (lowestCellValue == cells[adjIndex] && cells[cell] != cells[adjIndex])
+			possibleCells[numPossibleCells++] = adjIndex;
+		else if (lowestCellValue > cells[adjIndex]) {
+			lowestCellValue = cells[adjIndex];
+			possibleCells[0] = adjIndex;
+			numPossibleCells = 1;
 		}
 	}
 
 	/*
-	 * Decide the cell where the agent.mPos will move.
+	 * Decide the cell where the agent will move.
 	 */
-	if (possibleCoords.size() != 0) {
-		mCellStates[curIndex] = TYPE_EMPTY;
-		agent.mPos = possibleCoords[(int)floor(distribution(mRNG) * possibleCoords.size())];
-		mCellStates[convertTo1D(agent.mPos)] = TYPE_AGENT;
+	if (numPossibleCells != 0) {
+		std::uniform_real_distribution<> distribution(0.0, 1.0);
+		cellStates[cell] = TYPE_EMPTY;
+		cell = possibleCells[(int)floor(distribution(rng) * numPossibleCells)];
+		cellStates[cell] = TYPE_AGENT;
 	}
-}
\ No newline at end of file
+}
@@ -1,16 +1,40 @@
 #ifndef __CELLULARAUTOMATONMODEL_GA_H__
 #define __CELLULARAUTOMATONMODEL_GA_H__
 
+#include <unordered_map>
+#include "boost/functional/hash.hpp"
+
 #include "cellularAutomatonModel.h"
 #include "geneticAlgorithm.h"
 
+#define TOPOLOGY_RING 0 // receive migrants from the previous island only
+#define TOPOLOGY_FULL 1 // receive migrants from every other island
+
+struct Simulation_GA { // state of one simulation run for fitness evaluation (independent of the model and of other runs, and reusable across runs)
+	arrayNi mCells;      // store the 1-D cell index of every agent
+	arrayNi mGoals;      // store exit ID for every agent
+	arrayNb mIsAlive;
+	arrayNi mCellStates;
+	arrayNi mOrder;      // buffer of the updating order
+	int mNumAliveAgents;
+	int mTimesteps;
+	int mTotalTimesteps; // accumulate every agent's evacuation time
+	std::mt19937 mRNG;
+};
+
 class CellularAutomatonModel_GA : public CellularAutomatonModel {
 public:
 	CellularAutomatonModel_GA();
-	~CellularAutomatonModel_GA() { delete mGA; }
+	~CellularAutomatonModel_GA();
 	void update();
-	void save();
-	void draw();
+	void save() const;
+	void draw() const;
+	void optimize();       // run GA without drawing until it converges, and save the evacuation plan
+	void savePlan() const;
+	///
+	double evaluate( const arrayNi &plan, unsigned int seed, double cutoff = 0.0 ) const; // run one simulation following the plan and return the fitness (or an upper bound of it once the bound drops below cutoff)
+	double evaluate( const arrayNi &plan, unsigned int seed, double cutoff, Simulation_GA &sim ) const;
+	double getMaxFitness( const arrayNi &plan ) const;                                  // upper bound of the fitness of any simulation following the plan
 
 private:
 	GeneticAlgorithm *mGA;
@@ -18,25 +42,49 @@ private:
 	bool mHasConverged;
 	int mUnchangedBestCount, mTerminationCount;
 	double mLastBestFitness, mImprovementThresh;
+	int mNumReplicas;                 // number of simulations averaged for the fitness of one chromosome
+	std::vector<unsigned int> mSeeds; // common random numbers (every chromosome is evaluated with the same mNumReplicas seeds)
+	std::unordered_map<arrayNi, double, boost::hash<arrayNi>> mFitnessCache; // store the fitness of every evaluated chromosome
+	///
+	int mNumIslands, mIslandID;       // islands are separate processes sharing mIslandDir (mNumIslands = 1 disables migration)
+	int mMigrationInterval;           // number of generations between two migrations
+	int mNumMigrants;                 // number of best chromosomes sent to other islands per migration
+	int mTopology;
+	std::string mIslandDir;
+	std::mt19937 mRNG_init;           // draw the initial chromosomes (seeded from mRandomSeed and mIslandID)
+	arrayNi mLastImported;            // store the generation of the last migrants imported from every island
 
 	array2i mBlocksDim;               // [0]: width, [1]: height
 	arrayNi mBlocks;                  // store block ID of every cell
 	arrayNi mEvacPlan;                // store exit ID for every block (have the same size as one chromosome)
-	arrayNi mAgentGoals;              // store exit ID for every agent (grow or shrink as simStep() goes)
+	arrayNi mAgentGoals;              // store exit ID for every agent (use [index in mAgentManager.mPool] to access elements)
 	std::vector<array3f> mExitColors; // store the color of every exit
+	arrayNb mIsExitCell;              // whether every cell belongs to an exit
+	std::vector<arrayNi> mExitRankings; // store exit IDs sorted by the distance to every block
 	int mTotalTimesteps;              // accumulate every agent's evacuation time
 
 	void read( const char *fileName );
-	void print();
+	void print() const;
 	void reset();
 	void assignExitColors();
+	void setExitCells();
+	void setExitRankings();
 	void initPopulation();
 	void evaluatePopulation();
+	int getMinTotalTimesteps( const arrayNi &plan ) const;
 	void generateGoalsFromPlan( const arrayNi &plan );
 	void GAStep();
-	void simStep_GA( std::vector<Agent> &agents, arrayNb &isAlive, int &numAliveAgents );
+	void claimIsland();
+	void migrate();
+	std::string getIslandFileName( int id, const char *suffix ) const { return mIslandDir + "island_" + std::to_string(id) + suffix; }
+	void simStep_GA( Simulation_GA &sim ) const;
 	void simStep();
-	void moveAgents( Agent &agent, int goal, std::uniform_real_distribution<> &distribution );
+	void moveAgent( int &cell, int goal, arrayNi &cellStates, std::mt19937 &rng ) const;
+
+	/*
+	 * The definitions are in cellularAutomatonModel_GA_tbb.cpp.
+	 */
+	void evaluatePopulation_tbb();
 };
 
-#endif
\ No newline at end of file
+#endif
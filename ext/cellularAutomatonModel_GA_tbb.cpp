@@ -0,0 +1,181 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <unordered_set>
+#include <cfloat>
+#include <cmath>
+
+#include "cellularAutomatonModel_GA.h"
+
+static tbb::enumerable_thread_specific<Simulation_GA> simulations; // reusable simulation state of every thread
+
+struct EvaluatePopulation {
+	const CellularAutomatonModel_GA *mModel;
+	const std::vector<Genome> *mPopulation;
+	const arrayNi *mToDoList;        // indices of chromosomes to be evaluated in this round
+	unsigned int mSeed;              // common random number of this round
+	const std::vector<double> *mCutoffs; // a run is aborted once its fitness is proven to be below the cutoff
+	std::vector<double> *mResults;
+
+	void operator() (const tbb::blocked_range<size_t> &r) const {
+		Simulation_GA &sim = simulations.local();
+		for (size_t i = r.begin(); i < r.end(); i++) {
+			const Genome &chromosome = (*mPopulation)[(*mToDoList)[i]];
+			(*mResults)[i] = mModel->evaluate(chromosome.mGenes, mSeed, (*mCutoffs)[i], sim);
+		}
+	}
+};
+
+void CellularAutomatonModel_GA::evaluatePopulation_tbb() {
+	/*
+	 * Take the fitness from the cache if possible, and evaluate every other distinct chromosome only once.
+	 */
+	arrayNi toDoList;
+	std::unordered_set<arrayNi, boost::hash<arrayNi>> pending; // store the chromosomes in toDoList
+	for (size_t i = 0; i < mPopulation.size(); i++) {
+		if (mPopulation[i].mFitness > 0.0)
+			continue;
+
+		auto cached = mFitnessCache.find(mPopulation[i].mGenes);
+		if (cached != mFitnessCache.end())
+			mPopulation[i].mFitness = cached->second;
+		else if (pending.insert(mPopulation[i].mGenes).second)
+			toDoList.push_back(i);
+	}
+	if (toDoList.empty())
+		return;
+
+	/*
+	 * Find the elite cutoff, i.e., the fitness a chromosome has to exceed to enter the elite set of the next generation.
+	 */
+	double eliteCutoff = 0.0;
+	std::vector<double> knownFitness;
+	for (const auto &chromosome : mPopulation) {
+		if (chromosome.mFitness > 0.0)
+			knownFitness.push_back(chromosome.mFitness);
+	}
+	if (mGA->mNumElites > 0 && (int)knownFitness.size() >= mGA->mNumElites) {
+		std::nth_element(knownFitness.begin(), knownFitness.begin() + mGA->mNumElites - 1, knownFitness.end(), std::greater<double>());
+		eliteCutoff = knownFitness[mGA->mNumElites - 1];
+	}
+
+	/*
+	 * Run the replicas in rounds (successive halving).
+	 *  In round r, every remaining chromosome runs replica r. A run is aborted once the average over all replicas is proven to be below the elite cutoff,
+	 *  assuming every remaining replica reaches getMaxFitness(). After each round, only the better half of the chromosomes proceeds.
+	 */
+	std::vector<double> sums(mPopulation.size(), 0.0), maxFitness(mPopulation.size(), 0.0), abortedResults(mPopulation.size(), -1.0);
+	arrayNi numRuns(mPopulation.size(), 0);
+	arrayNb isComplete(mPopulation.size(), false);
+	for (const auto &i : toDoList)
+		maxFitness[i] = getMaxFitness(mPopulation[i].mGenes);
+
+	auto runReplica = [&](const arrayNi &list, int r, const std::vector<double> &cutoffs, std::vector<double> &results) {
+		EvaluatePopulation body;
+		body.mModel = this;
+		body.mPopulation = &mPopulation;
+		body.mToDoList = &list;
+		body.mSeed = mSeeds[r];
+		body.mCutoffs = &cutoffs;
+		body.mResults = &results;
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, list.size(), 1), body, tbb::simple_partitioner()); // every task runs a whole simulation
+	};
+
+	arrayNi remaining = toDoList;
+	for (int r = 0; r < mNumReplicas && !remaining.empty(); r++) {
+		std::vector<double> cutoffs(remaining.size(), 0.0), results(remaining.size());
+		if (eliteCutoff > 0.0) {
+			for (size_t i = 0; i < remaining.size(); i++)
+				cutoffs[i] = mNumReplicas * eliteCutoff - sums[remaining[i]] - (mNumReplicas - r - 1) * maxFitness[remaining[i]];
+		}
+		runReplica(remaining, r, cutoffs, results);
+
+		arrayNi next;
+		for (size_t i = 0; i < remaining.size(); i++) {
+			int index = remaining[i];
+			sums[index] += results[i];
+			numRuns[index]++;
+			if (results[i] < cutoffs[i]) { // hopeless (the result is only an upper bound)
+				abortedResults[index] = results[i];
+				continue;
+			}
+			if (numRuns[index] == mNumReplicas)
+				isComplete[index] = true;
+			else
+				next.push_back(index);
+		}
+
+		if (r < mNumReplicas - 1 && next.size() > 1) {
+			std::stable_sort(next.begin(), next.end(), [&](int lhs, int rhs) { return sums[lhs] / numRuns[lhs] > sums[rhs] / numRuns[rhs]; });
+			next.resize((next.size() + 1) / 2);
+		}
+		remaining = next;
+	}
+
+	/*
+	 * The best chromosome, the elites and the emigrants have to be complete evaluations. Chromosomes evaluated earlier are complete, so if fewer than that
+	 *  are complete, finish the most promising incomplete ones (an aborted replica is run again, since its result is only an upper bound).
+	 */
+	int numRequired = std::max(std::max(mGA->mNumElites, 1), mNumIslands > 1 ? mNumMigrants : 0);
+	int numComplete = 0;
+	arrayNi incomplete;
+	for (size_t i = 0; i < mPopulation.size(); i++) {
+		if (mPopulation[i].mFitness > 0.0 || isComplete[i])
+			numComplete++;
+	}
+	for (const auto &i : toDoList) {
+		if (!isComplete[i])
+			incomplete.push_back(i);
+	}
+	if (numComplete < numRequired && !incomplete.empty()) {
+		std::stable_sort(incomplete.begin(), incomplete.end(), [&](int lhs, int rhs) { return sums[lhs] / numRuns[lhs] > sums[rhs] / numRuns[rhs]; });
+		incomplete.resize(std::min((int)incomplete.size(), numRequired - numComplete));
+		for (const auto &i : incomplete) {
+			if (abortedResults[i] >= 0.0) {
+				sums[i] -= abortedResults[i];
+				numRuns[i]--;
+			}
+		}
+		for (int r = 0; r < mNumReplicas; r++) {
+			arrayNi list;
+			for (const auto &i : incomplete) {
+				if (numRuns[i] == r)
+					list.push_back(i);
+			}
+			std::vector<double> cutoffs(list.size(), 0.0), results(list.size());
+			runReplica(list, r, cutoffs, results);
+			for (size_t i = 0; i < list.size(); i++) {
+				sums[list[i]] += results[i];
+				numRuns[list[i]]++;
+			}
+		}
+		for (const auto &i : incomplete)
+			isComplete[i] = true;
+	}
+
+	/*
+	 * Set the fitness. Only complete evaluations are cached. The others are estimated from fewer replicas (or an upper bound), so they are capped
+	 *  below every complete evaluation and cannot outrank one.
+	 */
+	double minComplete = DBL_MAX;
+	for (size_t i = 0; i < mPopulation.size(); i++) {
+		if (isComplete[i])
+			minComplete = std::min(minComplete, sums[i] / numRuns[i]);
+		else if (mPopulation[i].mFitness > 0.0)
+			minComplete = std::min(minComplete, mPopulation[i].mFitness);
+	}
+	for (const auto &i : toDoList) {
+		mPopulation[i].mFitness = sums[i] / numRuns[i];
+		if (isComplete[i])
+			mFitnessCache[mPopulation[i].mGenes] = mPopulation[i].mFitness;
+		else if (minComplete < DBL_MAX)
+			mPopulation[i].mFitness = std::min(mPopulation[i].mFitness, std::nextafter(minComplete, 0.0));
+	}
+	std::unordered_map<arrayNi, double, boost::hash<arrayNi>> fitness; // copy the fitness to the duplicates
+	for (const auto &i : toDoList)
+		fitness[mPopulation[i].mGenes] = mPopulation[i].mFitness;
+	for (auto &chromosome : mPopulation) {
+		if (chromosome.mFitness == 0.0)
+			chromosome.mFitness = fitness[chromosome.mGenes];
+	}
+}
@@ -23,9 +23,9 @@ public:
 	bool mIsMovable;
 	bool mIsActive;
 	///
-	bool mIsAssigned;              // true if some agent ever moves it, false otherwise
-	arrayNi mInRange;              // store evacuees that are within its interference area
-	fixed_queue<float> mDensities; // store the evacuee density at every timestep
+	bool mIsAssigned;                  // true if some agent ever moves it, false otherwise
+	arrayNi mInRange;                  // store evacuees that are within its interference area
+	fixed_queue<float, 10> mDensities; // store the evacuee density at the last 10 timesteps
 
 	array2i mTmpPos; // cell the movable obstacle will be moved into at the next timestep
 };
@@ -43,9 +43,8 @@ public:
 	int mInChargeOf;                // store relation with the movable obstacle
 	int mStrength;                  // timesteps needed to move an obstacle into another cell
 	int mDest;                      // used by volunteers
-	int mCompanion;                 // used by evacuees
-	arrayNi mWhitelist, mBlacklist; // used by evacuees
-	arrayNf mCells;
+	id_set mWhitelist, mBlacklist;  // used by evacuees
+	arrayNf mCells;                 // used by volunteers (evacuees share fields through ObstacleRemovalModel::mCustomFloorFields)
 
 	array2i mTmpPos;   // cell the agent will move into at the next timestep
 	array2i mPosForGT;
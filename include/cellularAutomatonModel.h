@@ -4,6 +4,7 @@
 #include <random>
 #include <chrono>
 #include <numeric>
+#include <functional>
 
 #include "container.h"
 #include "floorField.h"
@@ -45,11 +46,14 @@ protected:
 	///
 	bool mFlgUpdateStatic;
 	bool mFlgAgentEdited;
+	bool mFlgAgentGenerated; // whether agents are generated by mRNG instead of being loaded
 
 	void generateAgents();
+	void regenerateAgents(); // replace every agent with ones generated by mRNG
 	void setCellStates();
 	int getFreeCell( const arrayNf &cells, const array2i &pos, float vmax, float vmin = -1.f );
 	int getFreeCell_p( const arrayNf &cells, const array2i &lastPos, const array2i &pos );
+	int getFreeCell_p( const std::function<float(int)> &getCell, const array2i &lastPos, const array2i &pos ); // for floor fields evaluated on demand
 	int getMinRandomly( std::vector<std::pair<int, float>> &vec );
 	int getOneRandomly( std::vector<std::pair<int, double>> &vec );
 	///
@@ -3,12 +3,15 @@
 
 #include <array>
 #include <vector>
-#include <deque>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 
 typedef std::array<int, 2> array2i;
 typedef std::array<float, 2> array2f;
 typedef std::array<bool, 2> array2b;
 
+typedef std::array<int, 3> array3i;
 typedef std::array<float, 3> array3f;
 
 typedef std::vector<int> arrayNi;
@@ -21,34 +24,183 @@ std::ostream &operator<<(std::ostream &os, const std::array<T, 2> &array) {
 	return os;
 }
 
-template<typename T>
-class fixed_queue {
+template<typename T, size_t N>
+class fixed_queue { // keep the last N values in a ring buffer along with their running sums
 public:
-	fixed_queue() {}
-	fixed_queue( size_t count ) : mLimit(count) {}
+	fixed_queue() : mFront(0), mSize(0), mSum(0.0), mSumSq(0.0) {}
 	T operator[]( size_t i ) const {
-		return mQ[i];
+		return mQ[(mFront + i) % N];
+	}
+	size_t size() const {
+		return mSize;
+	}
+	void clear() {
+		mFront = mSize = 0;
+		mSum = mSumSq = 0.0;
+	}
+	void push( T val ) {
+		if (mSize == N) {
+			mSum -= mQ[mFront];
+			mSumSq -= (double)mQ[mFront] * mQ[mFront];
+			mQ[mFront] = val;
+			mFront = (mFront + 1) % N;
+		}
+		else
+			mQ[(mFront + mSize++) % N] = val;
+		mSum += val;
+		mSumSq += (double)val * val;
+	}
+	float mean() const {
+		return (float)(mSum / mSize);
+	}
+	float stddev() const {
+		double mu = mSum / mSize;
+		return (float)sqrt(std::max(mSumSq / mSize - mu * mu, 0.0));
+	}
+
+private:
+	std::array<T, N> mQ;
+	size_t mFront, mSize;
+	double mSum, mSumSq; // double keeps the sums of float values in [0, 1] exact, so they never drift
+};
+
+class id_set { // set of non-negative IDs stored as a bitset, with an incrementally maintained hash
+public:
+	class const_iterator {
+	public:
+		const_iterator( const std::vector<uint64_t> *bits, int val ) : mBits(bits), mVal(val) { seek(); }
+		int operator*() const {
+			return mVal;
+		}
+		const_iterator &operator++() {
+			mVal++;
+			seek();
+			return *this;
+		}
+		bool operator!=( const const_iterator &it ) const {
+			return mVal != it.mVal;
+		}
+
+	private:
+		const std::vector<uint64_t> *mBits;
+		int mVal;
+
+		void seek() { // move to the next member (or to the end)
+			int end = mBits->size() * 64;
+			for (; mVal < end; mVal++) {
+				uint64_t word = (*mBits)[mVal >> 6] >> (mVal & 63);
+				if (word == 0)
+					mVal |= 63; // skip the rest of the word
+				else if (word & 1)
+					return;
+			}
+		}
+	};
+
+	struct hasher {
+		size_t operator()( const id_set &s ) const { return s.hash(); }
+	};
+
+	id_set() : mSize(0), mHash(0) {}
+	const_iterator begin() const {
+		return const_iterator(&mBits, 0);
 	}
-	typename std::deque<T>::iterator begin() {
-		return mQ.begin();
+	const_iterator end() const {
+		return const_iterator(&mBits, mBits.size() * 64);
 	}
-	typename std::deque<T>::iterator end() {
-		return mQ.end();
+	size_t size() const {
+		return mSize;
 	}
-	size_t size() {
-		return mQ.size();
+	bool empty() const {
+		return mSize == 0;
+	}
+	size_t hash() const {
+		return mHash;
+	}
+	bool contains( int val ) const {
+		return (size_t)(val >> 6) < mBits.size() && (mBits[val >> 6] >> (val & 63) & 1);
+	}
+	void insert( int val ) {
+		if ((size_t)(val >> 6) >= mBits.size())
+			mBits.resize((val >> 6) + 1, 0);
+		if (!contains(val)) {
+			mBits[val >> 6] |= (uint64_t)1 << (val & 63);
+			mSize++;
+			mHash ^= mix(val);
+		}
+	}
+	void erase( int val ) {
+		if (contains(val)) {
+			mBits[val >> 6] &= ~((uint64_t)1 << (val & 63));
+			mSize--;
+			mHash ^= mix(val);
+		}
+	}
+	template<typename Predicate>
+	void erase_if( Predicate cond ) {
+		for (const_iterator it = begin(); it != end(); ++it) {
+			if (cond(*it))
+				erase(*it);
+		}
+	}
+	void clear() { // keep the storage for reuse
+		std::fill(mBits.begin(), mBits.end(), 0);
+		mSize = 0;
+		mHash = 0;
+	}
+	bool operator==( const id_set &s ) const {
+		if (mHash != s.mHash || mSize != s.mSize)
+			return false;
+		for (size_t i = 0; i < std::max(mBits.size(), s.mBits.size()); i++) {
+			if ((i < mBits.size() ? mBits[i] : 0) != (i < s.mBits.size() ? s.mBits[i] : 0))
+				return false;
+		}
+		return true;
+	}
+
+private:
+	std::vector<uint64_t> mBits;
+	size_t mSize;
+	size_t mHash; // XOR of mix() over all members
+
+	static size_t mix( int val ) { // splitmix64 finalizer
+		uint64_t z = (uint64_t)val + 0x9e3779b97f4a7c15ULL;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return (size_t)(z ^ (z >> 31));
+	}
+};
+
+class bucket_grid {
+public:
+	bucket_grid() {}
+	bucket_grid( const array2i &dim, int bucketSize ) : mBucketSize(bucketSize) {
+		mDim = { (dim[0] + bucketSize - 1) / bucketSize, (dim[1] + bucketSize - 1) / bucketSize };
+		mBuckets.resize(mDim[0] * mDim[1]);
 	}
 	void clear() {
-		mQ.clear();
+		for (auto &bucket : mBuckets)
+			bucket.clear();
 	}
-	void push( T val ) {
-		if (mQ.size() == mLimit) mQ.pop_front();
-		mQ.push_back(val);
+	void insert( const array2i &pos, int val ) {
+		mBuckets[pos[1] / mBucketSize * mDim[0] + pos[0] / mBucketSize].push_back(val);
+	}
+	template<typename Function>
+	void query( const array2i &lower, const array2i &upper, Function f ) const { // visit values in buckets overlapping [lower, upper]
+		int x0 = std::max(lower[0], 0) / mBucketSize, x1 = std::min(upper[0] / mBucketSize, mDim[0] - 1);
+		int y0 = std::max(lower[1], 0) / mBucketSize, y1 = std::min(upper[1] / mBucketSize, mDim[1] - 1);
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				for (const auto &val : mBuckets[y * mDim[0] + x])
+					f(val);
+			}
+		}
 	}
 
 private:
-	std::deque<T> mQ;
-	size_t mLimit;
+	array2i mDim; // number of buckets in each dimension
+	int mBucketSize;
+	std::vector<arrayNi> mBuckets;
 };
 
 #endif
\ No newline at end of file
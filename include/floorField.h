@@ -22,6 +22,12 @@ using std::endl;
 
 class FloorField {
 public:
+	struct SearchBuffer { // reusable storage of evaluateCells_bounded()
+		arrayNi mTargets;
+		arrayNb mIsPopped;
+		std::vector<std::pair<float, int>> mToDoList; // binary heap
+	};
+
 	array2i mDim;    // [0]: width, [1]: height
 	float mCellSize;
 	arrayNf mCells;  // store the final floor field (use [y-coordinate * mDim[0] + x-coordinate] to access elements)
@@ -45,6 +51,9 @@ public:
 	///
 	void print() const;
 	void evaluateCells( int root, arrayNf &floorField, float offset_hv = 1.f ) const;
+	void evaluateCells_bounded( int root, const std::vector<array2i> &centers, arrayNf &floorField, float offset_hv = 1.f ) const; // only cells within one cell of centers are guaranteed to be final
+	void evaluateCells_bounded( int root, const std::vector<array2i> &centers, arrayNf &floorField, SearchBuffer &buffer, float offset_hv = 1.f ) const;
+	const arrayNf &getCellsForExitStatic( int i ) const { return mCellsForExitsStatic[i]; }
 
 	/*
 	 * Editing.
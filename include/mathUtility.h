@@ -41,4 +41,27 @@ static float stddev(InputIt first, InputIt last) {
 	return sqrt(diff / std::distance(first, last));
 }
 
+class running_stat { // streaming mean and variance (Welford's algorithm)
+public:
+	running_stat() : mCount(0), mMean(0.0), mM2(0.0) {}
+
+	void push(double x) {
+		mCount++;
+		double delta = x - mMean;
+		mMean += delta / mCount;
+		mM2 += delta * (x - mMean);
+	}
+	void clear() { mCount = 0; mMean = mM2 = 0.0; }
+
+	int count() const { return mCount; }
+	double mean() const { return mMean; }
+	double variance() const { return mCount > 1 ? mM2 / (mCount - 1) : 0.0; } // sample variance
+	double stddev() const { return sqrt(variance()); }
+
+private:
+	int mCount;
+	double mMean;
+	double mM2; // sum of squared differences from the current mean
+};
+
 #endif
\ No newline at end of file
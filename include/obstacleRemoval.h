@@ -1,11 +1,18 @@
 #ifndef __OBSTACLEREMOVAL_H__
 #define __OBSTACLEREMOVAL_H__
 
+#include <map>
+#include <set>
+#include <unordered_map>
 #include "IL/il.h"
 
 #include "cellularAutomatonModel.h"
 #include "mathUtility.h"
 
+struct CustomFloorField {
+	arrayNf mCellsStatic, mCellsStatic_e; // static floor fields in which blacklisted obstacles are also viewed as obstacles
+};
+
 class ObstacleRemovalModel : public CellularAutomatonModel {
 public:
 	std::string mPathsToTexture[2];
@@ -28,6 +35,7 @@ public:
 	void read( const char *fileName1, const char *fileName2 );
 	void save() const;
 	void update();
+	void reseed( unsigned int seed, unsigned int seed_GT ); // turn a copy of a freshly loaded model into a new experiment (streams fixed by RANDOM_SEED are kept)
 	///
 	void print() const;
 	void print( const arrayNf &cells ) const;
@@ -40,22 +48,43 @@ public:
 
 private:
 	unsigned int mRandomSeed_GT;
+	bool mFlgFixedSeed, mFlgFixedSeed_GT; // whether RANDOM_SEED fixes mRNG and mRNG_GT (reseed() keeps them)
 	std::mt19937 mRNG_GT;
 	GLuint mTextures[2];
 	arrayNi mMovableObstacleMap;
+	arrayNi mNumObsNeighbors;    // store the number of immovable obstacles and placed (STATE_DONE) movable obstacles around each cell
+	std::set<int> mDropOffCells; // store cells that have at least three obstacles as the neighbor (candidates in selectCellToPutObstacle)
+	std::vector<arrayNi> mExitNeighbors; // store sorted cells around each exit (excluding cells of the exit and immovable obstacles)
+	arrayNi mNumBlockingObstacles;       // store the number of movable obstacles in mExitNeighbors of each exit
+	arrayNi mExitToBlock;                // store the first exit each cell is right next to (STATE_NULL if none)
 	arrayNf mCellsAnticipation;
+	std::unordered_map<id_set, CustomFloorField, id_set::hasher> mCustomFloorFields; // shared by evacuees with the same blacklist
+	bucket_grid mEvacueeBuckets;                            // store indices (in mActiveAgents) of evacuees by their positions
+	std::vector<array3i> mInterferenceStencil;              // store the interference area as row spans ([0]: y offset, [1]-[2]: x offsets)
+	array2f mStencilParams;                                 // [0]: mInterferenceRadius, [1]: mFloorField.mLambda used by mInterferenceStencil
+	arrayNi mNumNonObsCellsSums, mNumEvacueesSums;          // per-row prefix sums (use [y-coordinate * (mFloorField.mDim[0] + 1) + x-coordinate + 1])
+	std::map<array2i, std::vector<array3i>> mAFFKernels;    // anticipation increments ([0]-[1]: offsets, [2]: increment) keyed by the volunteer-to-obstacle offset
+	array2f mAFFKernelParams;                               // [0]: mInfluenceRadius, [1]: mFloorField.mLambda used by mAFFKernels
+	bool mFlgUpdateCustomFF;                                // true if mCustomFloorFields is outdated because of scene changes
 
 	bool selectMovableObstacles();
 	void selectCellToPutObstacle( Agent &agent );
 	void moveVolunteer( Agent &agent );
 	void moveEvacuee( Agent &agent );
 	void maintainDataAboutSceneChanges( int type );
-	void customizeFloorField( Agent &agent ) const;
-	void syncFloorFieldForEvacuees();
-	void setCompanionForEvacuees();
+	void customizeFloorField( Agent &agent, bool isBounded = true ) const;
+	void customizeFloorField( const id_set &blacklist, CustomFloorField &field ) const;
+	void setCustomFloorFieldsForEvacuees( std::vector<std::pair<const id_set, CustomFloorField> *> &toDoList );
 	void setMovableObstacleMap();
+	void setDropOffCells();
+	void addObsNeighbor( int index );
+	void setExitNeighbors();
+	void moveBlockingObstacle( int from, int to );
 	void setAFF();
+	const std::vector<array3i> &getAFFKernel( const array2i &offset );
 	void calcDensity();
+	void setInterferenceStencil();
+	void setOccupancySums();
 	float calcBlockedProportion( const Obstacle &obstacle ) const;
 	int getFreeCell_if( const arrayNf &cells, const array2i &pos1, const array2i &pos2,
 		bool (*cond)( const array2i &, const array2i &, const array2i & ), float vmax, float vmin = -1.f );
@@ -63,6 +92,11 @@ private:
 	inline bool find( const arrayNi &vec, int val ) const { return std::find(vec.begin(), vec.end(), val) != vec.end() ? true : false; }
 	inline void erase( arrayNi &vec, int val ) const { vec.erase(std::remove(vec.begin(), vec.end(), val), vec.end()); }
 	inline void erase_if( arrayNi &vec, std::function<bool(int)> cond ) const { vec.erase(std::remove_if(vec.begin(), vec.end(), cond), vec.end()); }
+	inline float getCustomCell( const CustomFloorField &field, int i ) const {
+		float value = field.mCellsStatic[i];
+		if (!(value == INIT_WEIGHT || value == OBSTACLE_WEIGHT))
+			value = -mFloorField.mKS * value + mFloorField.mKD * mFloorField.mCellsDynamic[i] - mFloorField.mKE * field.mCellsStatic_e[i];
+		return value - mKA * mCellsAnticipation[i]; }
 	inline float calcVecLen( int x, int y ) const { return std::min(x, y) * mFloorField.mLambda + abs(x - y); }
 	inline bool isWithinInterferenceArea( const array2i &obstacle, const array2i &pos ) const {
 		return calcVecLen(abs(obstacle[0] - pos[0]), abs(obstacle[1] - pos[1])) <= mInterferenceRadius ? true : false; }
@@ -71,6 +105,7 @@ private:
 	 * The definitions are in obstacleRemoval_tbb.cpp.
 	 */
 	void maintainDataAboutSceneChanges_tbb( int type );
+	void setAFF_tbb();
 	void customizeFloorFieldForEvacuees_tbb();
 	void calcDensity_tbb();
 
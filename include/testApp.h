@@ -3,9 +3,31 @@
 
 #include "obstacleRemoval.h"
 
+struct Job { // one experiment of one parameter tuple
+	float mCy, mCv;
+	int mTTR;
+	float mD;
+	float mAroundVolunteersDist;        // distance within which evacuees are counted around volunteers
+	std::array<unsigned int, 2> mSeeds; // for mRNG and mRNG_GT
+	std::string mKey;                   // identify the job in the job file
+};
+
+struct VolunteerStats { // evacuees around volunteers in one experiment (see countEvacueesAroundVolunteers)
+	int mNumEvacuees, mNumVolunteers;
+	float mAvgTravelTS_e, mAvgTravelTS_v;
+	int mMaxTravelTS_e, mMinTravelTS_e;
+};
+
 class TestApp {
 public:
 	int mNumExpts;
+	unsigned int mRandomSeed; // experiment i of every parameter tuple draws its seeds from (mRandomSeed, i)
+	int mFlushInterval;       // number of finished jobs between two flushes of the job file
+	int mMinExpts;            // minimum number of experiments of every parameter tuple in the adaptive mode (mNumExpts is the maximum)
+	float mCIHalfWidth;       // target half-width of the 95% confidence interval of the mean evacuation time (0 disables the adaptive mode)
+	float mAroundVolunteersDist; // distance within which evacuees are counted around volunteers
+	std::string mSpoolDir;    // directory shared with worker processes (empty if the experiments run in this process)
+	int mLeaseTime;           // number of seconds after which the claim of a worker that stopped touching it expires
 	arrayNf mCyRange, mCvRange;
 	arrayNi mTTRRange;
 	arrayNf mDRange;
@@ -13,11 +35,32 @@ public:
 	TestApp();
 	void read( const char *fileName );
 	void runTest();
+	void runWorker(); // run the jobs queued in mSpoolDir until the sweep is finished
+	std::string runExperiment( const Job &job, ObstacleRemovalModel &model, int &timesteps, float &avgTravelTimesteps, VolunteerStats &stats,
+		const std::function<void()> &onUpdate = nullptr ) const; // run one job on model (called after every update if onUpdate is set), and return its record
 	void countEvacueesAroundVolunteers( const std::vector<Agent> &history, float dist, int &numEvacuees, int &numVolunteers,
 		float &avgTravelTS_e, float &avgTravelTS_v, int &maxTravelTS_e, int &minTravelTS_e ) const;
 
 private:
-	ObstacleRemovalModel mModel;
+	ObstacleRemovalModel mScene; // loaded once, and copied for every experiment
+
+	void setJobs( std::vector<Job> &jobs ) const; // use [parameter tuple index * mNumExpts + experiment index] to access elements
+	bool readJobs( const std::string &fileName, const std::vector<Job> &jobs, arrayNb &isDone, arrayNi &timesteps, arrayNf &avgTravelTimesteps, std::vector<VolunteerStats> &volunteerStats ) const; // return false if the last line is cut off
+	bool readRecord( const char *fields, int &timesteps, float &avgTravelTimesteps, VolunteerStats &stats ) const; // parse the fields after the key of a record
+	void runExperiments( const std::vector<Job> &jobs, const arrayNi &toDoList, arrayNi &timesteps, arrayNf &avgTravelTimesteps, std::vector<VolunteerStats> &volunteerStats, std::ofstream &ofs ) const;
+
+	/*
+	 * The definitions are in testApp_tbb.cpp.
+	 */
+	void runExperiments_tbb( const std::vector<Job> &jobs, const arrayNi &toDoList, arrayNi &timesteps, arrayNf &avgTravelTimesteps, std::vector<VolunteerStats> &volunteerStats, std::ofstream &ofs ) const;
+
+	/*
+	 * The definitions are in testApp_spool.cpp.
+	 */
+	bool openSpool() const; // return false if mSpoolDir belongs to another sweep
+	void closeSpool() const;
+	void runExperiments_spool( const std::vector<Job> &jobs, const arrayNi &toDoList, arrayNi &timesteps, arrayNf &avgTravelTimesteps, std::vector<VolunteerStats> &volunteerStats, std::ofstream &ofs ) const;
+	std::string getSpoolFileName( int i, const char *suffix ) const { return mSpoolDir + "job_" + std::to_string(i) + suffix; }
 };
 
 #endif
\ No newline at end of file
@@ -10,6 +10,7 @@ int main(int argc, char *argv[]) {
 	//TestApp app;
 
 	//app.runTest();
+	//app.runWorker(); // with SPOOL_DIR in config_test.txt, run any number of workers next to runTest()
 
 	return 0;
 }
\ No newline at end of file
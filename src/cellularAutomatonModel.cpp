@@ -7,7 +7,8 @@ CellularAutomatonModel::CellularAutomatonModel() {
 
 	mFloorField.read("./data/config_floorField.txt"); // load the scene, and initialize the static floor field
 
-	if (!mAgentManager.read("./data/config_agent.txt"))
+	mFlgAgentGenerated = !mAgentManager.read("./data/config_agent.txt");
+	if (mFlgAgentGenerated)
 		generateAgents();
 
 	mFloorField.update_p(UPDATE_DYNAMIC); // once the agents are loaded/generated, initialize the floor field
@@ -205,6 +206,13 @@ void CellularAutomatonModel::generateAgents() {
 	}
 }
 
+void CellularAutomatonModel::regenerateAgents() {
+	while (!mAgentManager.mActiveAgents.empty())
+		mAgentManager.deleteAgent(mAgentManager.mActiveAgents.size() - 1);
+	generateAgents();
+	setCellStates();
+}
+
 void CellularAutomatonModel::setCellStates() {
 	// initialize
 	std::fill(mCellStates.begin(), mCellStates.end(), TYPE_EMPTY);
@@ -244,6 +252,10 @@ int CellularAutomatonModel::getFreeCell(const arrayNf &cells, const array2i &pos
 }
 
 int CellularAutomatonModel::getFreeCell_p(const arrayNf &cells, const array2i &lastPos, const array2i &pos) {
+	return getFreeCell_p([&](int i) { return cells[i]; }, lastPos, pos);
+}
+
+int CellularAutomatonModel::getFreeCell_p(const std::function<float(int)> &getCell, const array2i &lastPos, const array2i &pos) {
 	int curIndex = convertTo1D(pos), adjIndex;
 	std::vector<std::pair<int, double>> possibleCoords;
 	possibleCoords.reserve(8);
@@ -257,9 +269,9 @@ int CellularAutomatonModel::getFreeCell_p(const arrayNf &cells, const array2i &l
 			if (isWithinBoundary(pos[0] + x, pos[1] + y) &&
 				mCellStates[adjIndex] == TYPE_EMPTY) {
 				if (adjIndex == convertTo1D(lastPos)) // avoid being attracted by its own virtual trace
-					possibleCoords.push_back(std::pair<int, double>(adjIndex, exp((double)cells[adjIndex] - mFloorField.mKD)));
+					possibleCoords.push_back(std::pair<int, double>(adjIndex, exp((double)getCell(adjIndex) - mFloorField.mKD)));
 				else
-					possibleCoords.push_back(std::pair<int, double>(adjIndex, exp((double)cells[adjIndex])));
+					possibleCoords.push_back(std::pair<int, double>(adjIndex, exp((double)getCell(adjIndex))));
 			}
 		}
 	}
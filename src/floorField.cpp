@@ -227,6 +227,94 @@ void FloorField::evaluateCells(int root, arrayNf &floorField, float offset_hv) c
 	}
 }
 
+void FloorField::evaluateCells_bounded(int root, const std::vector<array2i> &centers, arrayNf &floorField, float offset_hv) const {
+	SearchBuffer buffer;
+	evaluateCells_bounded(root, centers, floorField, buffer, offset_hv);
+}
+
+void FloorField::evaluateCells_bounded(int root, const std::vector<array2i> &centers, arrayNf &floorField, SearchBuffer &buffer, float offset_hv) const {
+	float offset_d = offset_hv * mLambda;
+	float offset_h = std::min(offset_d, 2.f * offset_hv); // the cheapest way to go one cell diagonally, used by the heuristic
+
+	/*
+	 * Collect the cells that must hold final values, i.e., the centers and their neighbors.
+	 */
+	arrayNi &targets = buffer.mTargets;
+	targets.clear();
+	array2i lower = { mDim[0], mDim[1] }, upper = { -1, -1 }; // bounding box of the targets
+	for (const auto &c : centers) {
+		for (int y = -1; y < 2; y++) {
+			for (int x = -1; x < 2; x++) {
+				if (c[0] + x < 0 || c[0] + x >= mDim[0] || c[1] + y < 0 || c[1] + y >= mDim[1])
+					continue;
+
+				int index = convertTo1D(c[0] + x, c[1] + y);
+				if (floorField[index] == OBSTACLE_WEIGHT || std::find(targets.begin(), targets.end(), index) != targets.end())
+					continue;
+				targets.push_back(index);
+				lower = { std::min(lower[0], c[0] + x), std::min(lower[1], c[1] + y) };
+				upper = { std::max(upper[0], c[0] + x), std::max(upper[1], c[1] + y) };
+			}
+		}
+	}
+	if (targets.empty())
+		return;
+
+	/*
+	 * Run A* from the root. The heuristic is the octile distance to the bounding box, which is consistent,
+	 * so a cell holds its final value once it is popped and the search stops when all targets are popped.
+	 */
+	auto heuristic = [&](int index) {
+		int x = std::max(0, std::max(lower[0] - index % mDim[0], index % mDim[0] - upper[0]));
+		int y = std::max(0, std::max(lower[1] - index / mDim[0], index / mDim[0] - upper[1]));
+		return std::min(x, y) * offset_h + abs(x - y) * offset_hv;
+	};
+	std::vector<std::pair<float, int>> &toDoList = buffer.mToDoList; // min-heap, as std::priority_queue with std::greater
+	std::greater<std::pair<float, int>> comp;
+	toDoList.clear();
+	toDoList.push_back(std::pair<float, int>(floorField[root] + heuristic(root), root));
+
+	arrayNb &isPopped = buffer.mIsPopped;
+	isPopped.assign(targets.size(), false);
+	size_t numRemainingTargets = targets.size();
+	while (!toDoList.empty()) {
+		int curIndex = toDoList.front().second, adjIndex;
+		float offset;
+		array2i cell = { curIndex % mDim[0], curIndex / mDim[0] };
+		bool isStale = toDoList.front().first > floorField[curIndex] + heuristic(curIndex); // the cell has been popped with a lower value
+		std::pop_heap(toDoList.begin(), toDoList.end(), comp);
+		toDoList.pop_back();
+		if (isStale)
+			continue;
+
+		arrayNi::const_iterator target = std::find(targets.begin(), targets.end(), curIndex);
+		if (target != targets.end() && !isPopped[target - targets.begin()]) {
+			isPopped[target - targets.begin()] = true;
+			if (--numRemainingTargets == 0)
+				return;
+		}
+
+		for (int y = -1; y < 2; y++) {
+			for (int x = -1; x < 2; x++) {
+				if (y == 0 && x == 0)
+					continue;
+
+				adjIndex = curIndex + y * mDim[0] + x;
+				if (cell[0] + x >= 0 && cell[0] + x < mDim[0] &&
+					cell[1] + y >= 0 && cell[1] + y < mDim[1] &&
+					floorField[adjIndex] != OBSTACLE_WEIGHT) {
+					offset = (x == 0 || y == 0) ? offset_hv : offset_d;
+					if (floorField[adjIndex] > floorField[curIndex] + offset) {
+						floorField[adjIndex] = floorField[curIndex] + offset;
+						toDoList.push_back(std::pair<float, int>(floorField[adjIndex] + heuristic(adjIndex), adjIndex));
+						std::push_heap(toDoList.begin(), toDoList.end(), comp);
+					}
+				}
+			}
+		}
+	}
+}
+
 boost::optional<array2i> FloorField::isExisting_exit(const array2i &coord) const {
 	for (size_t i = 0; i < mExits.size(); i++) {
 		auto j = std::find(mExits[i].mPos.begin(), mExits[i].mPos.end(), coord);
@@ -335,7 +423,7 @@ int FloorField::addObstacle(const array2i &coord, bool isMovable) {
 	mPool_o[i].mIsActive = true;
 	mPool_o[i].mIsAssigned = false;
 	mPool_o[i].mInRange.clear();
-	mPool_o[i].mDensities = fixed_queue<float>(10);
+	mPool_o[i].mDensities.clear();
 
 	return i;
 }
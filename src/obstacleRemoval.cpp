@@ -2,14 +2,20 @@
 
 ObstacleRemovalModel::ObstacleRemovalModel() {
 	mMaxTravelTimesteps = INT_MAX;
+	mFlgFixedSeed = mFlgFixedSeed_GT = false;
 	read("./data/config_obstacleRemoval.txt", "./data/config_agent_history.txt");
 
 	mMovableObstacleMap.resize(mFloorField.mDim[0] * mFloorField.mDim[1]);
+	mNumObsNeighbors.resize(mFloorField.mDim[0] * mFloorField.mDim[1]);
+	mExitToBlock.resize(mFloorField.mDim[0] * mFloorField.mDim[1]);
 	setMovableObstacleMap();
 
 	mCellsAnticipation.resize(mFloorField.mDim[0] * mFloorField.mDim[1]);
 	setAFF();
 
+	mFlgUpdateCustomFF = false;
+	mEvacueeBuckets = bucket_grid(mFloorField.mDim, std::max((int)ceil(mInterferenceRadius), 1));
+
 	mHistory.reserve(mAgentManager.mActiveAgents.size());
 	mFFDisplayType = 0;
 	mAgentVisualizationType = 0;
@@ -26,13 +32,13 @@ void ObstacleRemovalModel::read(const char *fileName1, const char *fileName2) {
 			long long randomSeed, randomSeed_GT;
 			ifs >> randomSeed >> randomSeed_GT;
 
-			if (randomSeed != -1) {
+			mFlgFixedSeed = randomSeed != -1;
+			mFlgFixedSeed_GT = randomSeed_GT != -1;
+			if (mFlgFixedSeed) {
 				mRandomSeed = (unsigned int)randomSeed;
 				mRNG.seed(mRandomSeed);
-				while (!mAgentManager.mActiveAgents.empty())
-					mAgentManager.deleteAgent(mAgentManager.mActiveAgents.size() - 1);
-				generateAgents();
-				setCellStates();
+				regenerateAgents();
+				mFlgAgentGenerated = true;
 			}
 			mRandomSeed_GT = randomSeed_GT == -1 ? std::random_device{}() : (unsigned int)randomSeed_GT;
 			mRNG_GT.seed(mRandomSeed_GT);
@@ -118,6 +124,25 @@ void ObstacleRemovalModel::save() const {
 	CellularAutomatonModel::save();
 }
 
+void ObstacleRemovalModel::reseed(unsigned int seed, unsigned int seed_GT) {
+	assert(mTimesteps == 0 && "Only a freshly loaded model can be reseeded");
+
+	/*
+	 * Only the streams left random by RANDOM_SEED (-1) are replaced, so a fixed seed keeps the same crowd in every experiment.
+	 *  Agents are regenerated if they come from mRNG (the scene, obstacles and the static floor field are kept).
+	 */
+	if (!mFlgFixedSeed) {
+		mRandomSeed = seed;
+		mRNG.seed(mRandomSeed);
+		if (mFlgAgentGenerated)
+			regenerateAgents();
+	}
+	if (!mFlgFixedSeed_GT) {
+		mRandomSeed_GT = seed_GT;
+		mRNG_GT.seed(mRandomSeed_GT);
+	}
+}
+
 void ObstacleRemovalModel::update() {
 	if (mAgentManager.mActiveAgents.empty())
 		return;
@@ -159,8 +184,8 @@ void ObstacleRemovalModel::update() {
 			}
 
 			if (mAgentManager.mPool[i].mInChargeOf == STATE_NULL) {
-				erase_if(mAgentManager.mPool[i].mWhitelist, [&](int j) { return !mFloorField.mPool_o[j].mIsActive; });
-				erase_if(mAgentManager.mPool[i].mBlacklist, [&](int j) { return !mFloorField.mPool_o[j].mIsActive; });
+				mAgentManager.mPool[i].mWhitelist.erase_if([&](int j) { return !mFloorField.mPool_o[j].mIsActive; });
+				mAgentManager.mPool[i].mBlacklist.erase_if([&](int j) { return !mFloorField.mPool_o[j].mIsActive; });
 			}
 		}
 		maintainDataAboutSceneChanges_tbb(UPDATE_STATIC);
@@ -180,11 +205,6 @@ void ObstacleRemovalModel::update() {
 					mFloorField.mExits[j].mLeavingTimesteps = mTimesteps;
 					mFloorField.mExits[j].mAccumulatedTimesteps += mTimesteps;
 
-					for (const auto &k : mFloorField.mActiveObstacles) {
-						if (mFloorField.mPool_o[k].mIsMovable && !mFloorField.mPool_o[k].mIsAssigned)
-							erase(mFloorField.mPool_o[k].mInRange, mAgentManager.mActiveAgents[i]);
-					}
-
 					mAgentManager.mPool[mAgentManager.mActiveAgents[i]].mUsedExit = j;
 					mCellStates[convertTo1D(mAgentManager.mPool[mAgentManager.mActiveAgents[i]].mPos)] = TYPE_EMPTY;
 					mHistory.push_back(mAgentManager.mPool[mAgentManager.mActiveAgents[i]]);
@@ -203,27 +223,33 @@ void ObstacleRemovalModel::update() {
 	/*
 	 * Collect evacuees that should play the volunteer's dilemma game.
 	 */
+	mEvacueeBuckets.clear();
+	for (size_t j = 0; j < mAgentManager.mActiveAgents.size(); j++) {
+		if (mAgentManager.mPool[mAgentManager.mActiveAgents[j]].mInChargeOf == STATE_NULL)
+			mEvacueeBuckets.insert(mAgentManager.mPool[mAgentManager.mActiveAgents[j]].mPos, j);
+	}
+
+	int r = (int)ceil(mInterferenceRadius);
+	arrayNb isInRange(mAgentManager.mPool.size(), false);
+	arrayNi entrants;
 	for (const auto &i : mFloorField.mActiveObstacles) {
 		if (mFloorField.mPool_o[i].mIsMovable && !mFloorField.mPool_o[i].mIsAssigned) {
-			for (const auto &j : mAgentManager.mActiveAgents) {
-				if (mAgentManager.mPool[j].mInChargeOf == STATE_NULL) {
-					// evacuee j enters the interference area of obstacle i
-					if (isWithinInterferenceArea(mFloorField.mPool_o[i].mPos, mAgentManager.mPool[j].mPos)) {
-						if (!find(mFloorField.mPool_o[i].mInRange, j))
-							mFloorField.mPool_o[i].mInRange.push_back(j);
-					}
-					// evacuee j leaves the interference area of obstacle i
-					else {
-						if (find(mFloorField.mPool_o[i].mInRange, j))
-							erase(mFloorField.mPool_o[i].mInRange, j);
-					}
-				}
-				else {
-					// evacuee j became a volunteer at the previous timestep
-					if (find(mFloorField.mPool_o[i].mInRange, j))
-						erase(mFloorField.mPool_o[i].mInRange, j);
-				}
-			}
+			Obstacle &obstacle = mFloorField.mPool_o[i];
+
+			// evacuee j leaves the interference area of obstacle i, leaves the scene, or became a volunteer at the previous timestep
+			erase_if(obstacle.mInRange, [&](int j) { return !mAgentManager.mPool[j].mIsActive || mAgentManager.mPool[j].mInChargeOf != STATE_NULL ||
+				!isWithinInterferenceArea(obstacle.mPos, mAgentManager.mPool[j].mPos); });
+
+			// evacuee j enters the interference area of obstacle i (appended in the order of mActiveAgents)
+			std::for_each(obstacle.mInRange.begin(), obstacle.mInRange.end(), [&](int j) { isInRange[j] = true; });
+			entrants.clear();
+			mEvacueeBuckets.query(array2i{ obstacle.mPos[0] - r, obstacle.mPos[1] - r }, array2i{ obstacle.mPos[0] + r, obstacle.mPos[1] + r }, [&](int j) {
+				if (!isInRange[mAgentManager.mActiveAgents[j]] && isWithinInterferenceArea(obstacle.mPos, mAgentManager.mPool[mAgentManager.mActiveAgents[j]].mPos))
+					entrants.push_back(j); });
+			std::sort(entrants.begin(), entrants.end());
+			std::for_each(obstacle.mInRange.begin(), obstacle.mInRange.end(), [&](int j) { isInRange[j] = false; });
+			for (const auto &j : entrants)
+				obstacle.mInRange.push_back(mAgentManager.mActiveAgents[j]);
 		}
 	}
 
@@ -236,20 +262,19 @@ void ObstacleRemovalModel::update() {
 				float tau = calcBlockedProportion(mFloorField.mPool_o[i]);
 				if (tau == 1.f) { // the exit is totally blocked
 					for (const auto &j : mFloorField.mPool_o[i].mInRange) {
-						erase(mAgentManager.mPool[j].mBlacklist, i);
-						if (!find(mAgentManager.mPool[j].mWhitelist, i))
-							mAgentManager.mPool[j].mWhitelist.push_back(i);
+						mAgentManager.mPool[j].mBlacklist.erase(i);
+						mAgentManager.mPool[j].mWhitelist.insert(i);
 					}
 				}
 				else {
 					solveConflict_volunteer(mFloorField.mPool_o[i].mInRange, powf(1.f - tau, 1.f / mFloorField.mPool_o[i].mInRange.size()));
 					for (const auto &j : mFloorField.mPool_o[i].mInRange) {
-						erase(mAgentManager.mPool[j].mWhitelist, i);
-						erase(mAgentManager.mPool[j].mBlacklist, i);
+						mAgentManager.mPool[j].mWhitelist.erase(i);
+						mAgentManager.mPool[j].mBlacklist.erase(i);
 						if (mAgentManager.mPool[j].mStrategy[1])
-							mAgentManager.mPool[j].mWhitelist.push_back(i);
+							mAgentManager.mPool[j].mWhitelist.insert(i);
 						else
-							mAgentManager.mPool[j].mBlacklist.push_back(i);
+							mAgentManager.mPool[j].mBlacklist.insert(i);
 					}
 				}
 			}
@@ -260,8 +285,7 @@ void ObstacleRemovalModel::update() {
 			for (const auto &i : mFloorField.mActiveObstacles) {
 				if (mFloorField.mPool_o[i].mIsMovable && !mFloorField.mPool_o[i].mIsAssigned) {
 					for (const auto &j : mFloorField.mPool_o[i].mInRange) {
-						if (!find(mAgentManager.mPool[j].mBlacklist, i))
-							mAgentManager.mPool[j].mBlacklist.push_back(i);
+						mAgentManager.mPool[j].mBlacklist.insert(i);
 					}
 				}
 			}
@@ -272,13 +296,13 @@ void ObstacleRemovalModel::update() {
 			for (const auto &i : mFloorField.mActiveObstacles) {
 				if (mFloorField.mPool_o[i].mIsMovable && !mFloorField.mPool_o[i].mIsAssigned) {
 					for (const auto &j : mFloorField.mPool_o[i].mInRange) {
-						erase(mAgentManager.mPool[j].mWhitelist, i);
-						erase(mAgentManager.mPool[j].mBlacklist, i);
+						mAgentManager.mPool[j].mWhitelist.erase(i);
+						mAgentManager.mPool[j].mBlacklist.erase(i);
 						if (calcBlockedProportion(mFloorField.mPool_o[i]) == 1.f ||
-							mean(mFloorField.mPool_o[i].mDensities.begin(), mFloorField.mPool_o[i].mDensities.end()) >= mEvacueeDensity)
-							mAgentManager.mPool[j].mWhitelist.push_back(i);
+							mFloorField.mPool_o[i].mDensities.mean() >= mEvacueeDensity)
+							mAgentManager.mPool[j].mWhitelist.insert(i);
 						else
-							mAgentManager.mPool[j].mBlacklist.push_back(i);
+							mAgentManager.mPool[j].mBlacklist.insert(i);
 					}
 				}
 			}
@@ -301,10 +325,11 @@ void ObstacleRemovalModel::update() {
 		if (mAgentManager.mPool[i].mInChargeOf != STATE_NULL) {
 			// the number of evacuees around the obstacle is too few
 			if (calcBlockedProportion(mFloorField.mPool_o[mAgentManager.mPool[i].mInChargeOf]) < 1.f &&
-				mean(mFloorField.mPool_o[mAgentManager.mPool[i].mInChargeOf].mDensities.begin(), mFloorField.mPool_o[mAgentManager.mPool[i].mInChargeOf].mDensities.end()) < mEvacueeDensity) {
+				mFloorField.mPool_o[mAgentManager.mPool[i].mInChargeOf].mDensities.mean() < mEvacueeDensity) {
 				mMovableObstacleMap[convertTo1D(mFloorField.mPool_o[mAgentManager.mPool[i].mInChargeOf].mPos)] = STATE_IDLE;
 				mFloorField.mPool_o[mAgentManager.mPool[i].mInChargeOf].mIsAssigned = false;
 				mAgentManager.mPool[i].mInChargeOf = STATE_NULL;
+				mFlgUpdateCustomFF = true; // evacuees no longer view the obstacle as an obstacle unless they blacklist it
 				goto label2;
 			}
 
@@ -335,41 +360,29 @@ void ObstacleRemovalModel::update() {
 	/*
 	 * Handle agent interaction (yielder game).
 	 */
-	arrayNb processed(mAgentManager.mActiveAgents.size());
-	for (size_t i = 0; i < mAgentManager.mActiveAgents.size(); i++) {
-		Agent &agent = mAgentManager.mPool[mAgentManager.mActiveAgents[i]];
+	std::vector<arrayNi> conflicts;                                              // groups are ordered by their first members in mActiveAgents
+	arrayNi conflictAt(mFloorField.mDim[0] * mFloorField.mDim[1], STATE_NULL); // store the index (in conflicts) of the group targeting each cell
+	for (const auto &i : mAgentManager.mActiveAgents) {
+		Agent &agent = mAgentManager.mPool[i];
 
 		// only consider agents who take action at the current timestep
 		if (agent.mInChargeOf != STATE_NULL && agent.mTmpPos == agent.mPos &&
 			mFloorField.mPool_o[agent.mInChargeOf].mTmpPos == mFloorField.mPool_o[agent.mInChargeOf].mPos)
-			processed[i] = true;
+			continue;
 		else if (agent.mInChargeOf == STATE_NULL && agent.mTmpPos == agent.mPos)
-			processed[i] = true;
-		else
-			processed[i] = false;
-	}
-
-	arrayNi agentsInConflict;
-	bool flag = false; // true if some volunteers attain the desired positions for their obstacles
-	for (size_t i = 0; i < mAgentManager.mActiveAgents.size(); i++) {
-		if (processed[i])
 			continue;
 
-		agentsInConflict.clear();
-		agentsInConflict.push_back(mAgentManager.mActiveAgents[i]);
-		processed[i] = true;
-
 		// gather agents that have the common target
-		for (size_t j = i + 1; j < mAgentManager.mActiveAgents.size(); j++) {
-			if (processed[j])
-				continue;
-
-			if (mAgentManager.mPool[mAgentManager.mActiveAgents[i]].mPosForGT == mAgentManager.mPool[mAgentManager.mActiveAgents[j]].mPosForGT) {
-				agentsInConflict.push_back(mAgentManager.mActiveAgents[j]);
-				processed[j] = true;
-			}
+		int &k = conflictAt[convertTo1D(agent.mPosForGT)];
+		if (k == STATE_NULL) {
+			k = conflicts.size();
+			conflicts.push_back(arrayNi());
 		}
+		conflicts[k].push_back(i);
+	}
 
+	bool flag = false; // true if some volunteers attain the desired positions for their obstacles
+	for (auto &agentsInConflict : conflicts) {
 		// pick one agent to satisfy it
 		int j = solveConflict_yielder(agentsInConflict);
 		if (j != STATE_NULL) {
@@ -386,6 +399,7 @@ void ObstacleRemovalModel::update() {
 					mMovableObstacleMap[convertTo1D(obstacle.mPos)] = STATE_NULL;
 					winner.mPos = winner.mTmpPos;
 					winner.mFacingDir = norm(winner.mTmpPos, obstacle.mTmpPos);
+					moveBlockingObstacle(convertTo1D(obstacle.mPos), convertTo1D(obstacle.mTmpPos));
 					obstacle.mPos = obstacle.mTmpPos;
 				}
 				// case 2: adjust the obstacle before pushing it
@@ -395,6 +409,7 @@ void ObstacleRemovalModel::update() {
 					mMovableObstacleMap[convertTo1D(obstacle.mTmpPos)] = mMovableObstacleMap[convertTo1D(obstacle.mPos)];
 					mMovableObstacleMap[convertTo1D(obstacle.mPos)] = STATE_NULL;
 					winner.mFacingDir = norm(winner.mTmpPos, obstacle.mTmpPos);
+					moveBlockingObstacle(convertTo1D(obstacle.mPos), convertTo1D(obstacle.mTmpPos));
 					obstacle.mPos = obstacle.mTmpPos;
 				}
 				// case 3: move around the obstacle
@@ -414,6 +429,7 @@ void ObstacleRemovalModel::update() {
 					mMovableObstacleMap[convertTo1D(obstacle.mPos)] = STATE_NULL;
 					winner.mPos = winner.mTmpPos;
 					winner.mFacingDir = norm(winner.mTmpPos, obstacle.mTmpPos);
+					moveBlockingObstacle(convertTo1D(obstacle.mPos), convertTo1D(obstacle.mTmpPos));
 					obstacle.mPos = obstacle.mTmpPos;
 				}
 				flag = true;
@@ -421,6 +437,7 @@ void ObstacleRemovalModel::update() {
 				// check if the task is done
 				if (winner.mCells[convertTo1D(obstacle.mPos)] == EXIT_WEIGHT) {
 					mMovableObstacleMap[convertTo1D(obstacle.mPos)] = STATE_DONE;
+					addObsNeighbor(convertTo1D(obstacle.mPos));
 					winner.mInChargeOf = STATE_NULL;
 				}
 
@@ -494,16 +511,16 @@ void ObstacleRemovalModel::print() const {
 		}
 		else
 			printf("|        |         |");
-		if (!agent.mWhitelist.empty()) {
-			printf("%d", agent.mWhitelist[0]);
-			for (size_t j = 1; j < agent.mWhitelist.size(); j++)
-				printf(", %d", agent.mWhitelist[j]);
+		const char *separator = "";
+		for (const auto &j : agent.mWhitelist) {
+			printf("%s%d", separator, j);
+			separator = ", ";
 		}
 		printf("/");
-		if (!agent.mBlacklist.empty()) {
-			printf("%d", agent.mBlacklist[0]);
-			for (size_t j = 1; j < agent.mBlacklist.size(); j++)
-				printf(", %d", agent.mBlacklist[j]);
+		separator = "";
+		for (const auto &j : agent.mBlacklist) {
+			printf("%s%d", separator, j);
+			separator = ", ";
 		}
 		printf("\n");
 	}
@@ -685,7 +702,7 @@ bool ObstacleRemovalModel::selectMovableObstacles() {
 				// evacuee j is right next to obstacle i and also wants to remove it
 				if (abs(mFloorField.mPool_o[i].mPos[0] - mAgentManager.mPool[j].mPos[0]) <= 1 &&
 					abs(mFloorField.mPool_o[i].mPos[1] - mAgentManager.mPool[j].mPos[1]) <= 1 &&
-					find(mAgentManager.mPool[j].mWhitelist, i))
+					mAgentManager.mPool[j].mWhitelist.contains(i))
 					candidates.push_back(j);
 			}
 
@@ -703,8 +720,8 @@ bool ObstacleRemovalModel::selectMovableObstacles() {
 				flag = true;
 
 				for (const auto &k : mFloorField.mPool_o[i].mInRange) {
-					erase(mAgentManager.mPool[k].mWhitelist, i);
-					erase(mAgentManager.mPool[k].mBlacklist, i);
+					mAgentManager.mPool[k].mWhitelist.erase(i);
+					mAgentManager.mPool[k].mBlacklist.erase(i);
 				}
 				mFloorField.mPool_o[i].mInRange.clear();
 			}
@@ -718,44 +735,27 @@ void ObstacleRemovalModel::selectCellToPutObstacle(Agent &agent) {
 	 * Compute the distance to all occupiable cells.
 	 */
 	agent.mDest = convertTo1D(mFloorField.mPool_o[agent.mInChargeOf].mPos);
-	customizeFloorField(agent);
+	customizeFloorField(agent, false); // every candidate cell may be queried
 
 	/*
 	 * Choose a cell that meets three conditions:
 	 *  1. It is empty or occupied by another agent.
 	 *  2. It is mMinDistFromExits away from the exit.
-	 *  3. It has at least three obstacles as the neighbor.
+	 *  3. It has at least three obstacles as the neighbor (maintained by mDropOffCells).
 	 */
 	std::vector<std::pair<int, float>> possibleCoords_f, possibleCoords_b;
-	for (size_t curIndex = 0; curIndex < agent.mCells.size(); curIndex++) {
+	array2f dir_ao = norm(agent.mPos, mFloorField.mPool_o[agent.mInChargeOf].mPos);
+	for (const auto &curIndex : mDropOffCells) {
 		if (!(mCellStates[curIndex] == TYPE_EMPTY || mCellStates[curIndex] == TYPE_AGENT) ||
 			mFloorField.mCellsStatic[curIndex] < mMinDistFromExits ||
 			curIndex == convertTo1D(agent.mPos))
 			continue;
 
-		array2i cell = { (int)curIndex % mFloorField.mDim[0], (int)curIndex / mFloorField.mDim[0] };
-		int adjIndex, numObsNeighbors = 0;
-
-		for (int y = -1; y < 2; y++) {
-			for (int x = -1; x < 2; x++) {
-				if (y == 0 && x == 0)
-					continue;
-
-				adjIndex = curIndex + y * mFloorField.mDim[0] + x;
-				if (isWithinBoundary(cell[0] + x, cell[1] + y) &&
-					(mCellStates[adjIndex] == TYPE_IMMOVABLE_OBSTACLE || mMovableObstacleMap[adjIndex] == STATE_DONE))
-					numObsNeighbors++;
-			}
-		}
-
-		if (numObsNeighbors > 2) {
-			array2f dir_ao = norm(agent.mPos, mFloorField.mPool_o[agent.mInChargeOf].mPos);
-			array2f dir_ac = norm(agent.mPos, cell);
-			if (dir_ao[0] * dir_ac[0] + dir_ao[1] * dir_ac[1] < 0.f) // cell is in back of the volunteer
-				possibleCoords_b.push_back(std::pair<int, float>(curIndex, agent.mCells[curIndex]));
-			else
-				possibleCoords_f.push_back(std::pair<int, float>(curIndex, agent.mCells[curIndex]));
-		}
+		array2f dir_ac = norm(agent.mPos, array2i{ curIndex % mFloorField.mDim[0], curIndex / mFloorField.mDim[0] });
+		if (dir_ao[0] * dir_ac[0] + dir_ao[1] * dir_ac[1] < 0.f) // cell is in back of the volunteer
+			possibleCoords_b.push_back(std::pair<int, float>(curIndex, agent.mCells[curIndex]));
+		else
+			possibleCoords_f.push_back(std::pair<int, float>(curIndex, agent.mCells[curIndex]));
 	}
 
 	/*
@@ -845,9 +845,13 @@ void ObstacleRemovalModel::moveVolunteer(Agent &agent) {
 }
 
 void ObstacleRemovalModel::moveEvacuee(Agent &agent) {
-	int adjIndex = !agent.mBlacklist.empty()
-		? getFreeCell_p(agent.mCells, agent.mLastPos, agent.mPos)
-		: getFreeCell_p(mFloorField.mCells, agent.mLastPos, agent.mPos);
+	int adjIndex;
+	if (!agent.mBlacklist.empty()) {
+		const CustomFloorField &field = mCustomFloorFields.at(agent.mBlacklist);
+		adjIndex = getFreeCell_p([&](int i) { return getCustomCell(field, i); }, agent.mLastPos, agent.mPos);
+	}
+	else
+		adjIndex = getFreeCell_p(mFloorField.mCells, agent.mLastPos, agent.mPos);
 
 	if (adjIndex != STATE_NULL) {
 		agent.mTmpPos = { adjIndex % mFloorField.mDim[0], adjIndex / mFloorField.mDim[0] };
@@ -861,82 +865,95 @@ void ObstacleRemovalModel::maintainDataAboutSceneChanges(int type) {
 	std::transform(mFloorField.mCells.begin(), mFloorField.mCells.end(), mCellsAnticipation.begin(), mFloorField.mCells.begin(),
 		[=](float i, float j) { return i - mKA * j; });
 
-	setCompanionForEvacuees();
+	if (type != UPDATE_DYNAMIC)
+		mFlgUpdateCustomFF = true;
+
+	std::vector<std::pair<const id_set, CustomFloorField> *> toDoList;
+	setCustomFloorFieldsForEvacuees(toDoList);
 	for (const auto &i : mAgentManager.mActiveAgents) {
-		if (mAgentManager.mPool[i].mInChargeOf != STATE_NULL || (!mAgentManager.mPool[i].mBlacklist.empty() && mAgentManager.mPool[i].mCompanion == STATE_NULL))
+		if (mAgentManager.mPool[i].mInChargeOf != STATE_NULL)
 			customizeFloorField(mAgentManager.mPool[i]);
 	}
-	syncFloorFieldForEvacuees();
+	for (const auto &field : toDoList)
+		customizeFloorField(field->first, field->second);
 }
 
-void ObstacleRemovalModel::customizeFloorField(Agent &agent) const {
-	assert(((agent.mInChargeOf != STATE_NULL && agent.mDest != STATE_NULL) || !agent.mBlacklist.empty()) && "Error when customizing the floor field");
+void ObstacleRemovalModel::customizeFloorField(Agent &agent, bool isBounded) const {
+	assert(agent.mInChargeOf != STATE_NULL && agent.mDest != STATE_NULL && "Error when customizing the floor field");
 	agent.mCells.resize(mFloorField.mDim[0] * mFloorField.mDim[1]);
 	std::fill(agent.mCells.begin(), agent.mCells.end(), INIT_WEIGHT);
 
-	if (agent.mInChargeOf != STATE_NULL) { // for volunteers
-		agent.mCells[agent.mDest] = EXIT_WEIGHT;
-		for (const auto &exit : mFloorField.mExits) {
-			for (const auto &e : exit.mPos)
-				agent.mCells[convertTo1D(e)] = OBSTACLE_WEIGHT;
-		}
-		for (const auto &i : mFloorField.mActiveObstacles) {
-			if (i != agent.mInChargeOf)
-				agent.mCells[convertTo1D(mFloorField.mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
-		}
-		mFloorField.evaluateCells(agent.mDest, agent.mCells);
+	agent.mCells[agent.mDest] = EXIT_WEIGHT;
+	for (const auto &exit : mFloorField.mExits) {
+		for (const auto &e : exit.mPos)
+			agent.mCells[convertTo1D(e)] = OBSTACLE_WEIGHT;
 	}
-	else { // for evacuees
-		arrayNf cells_e(agent.mCells);
-		for (const auto &i : agent.mBlacklist)
-			agent.mCells[convertTo1D(mFloorField.mPool_o[i].mPos)] = cells_e[convertTo1D(mFloorField.mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
-		for (const auto &i : mFloorField.mActiveObstacles) {
-			if (mFloorField.mPool_o[i].mIsMovable && !mFloorField.mPool_o[i].mIsAssigned)
-				continue;
-			agent.mCells[convertTo1D(mFloorField.mPool_o[i].mPos)] = cells_e[convertTo1D(mFloorField.mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
-		}
+	for (const auto &i : mFloorField.mActiveObstacles) {
+		if (i != agent.mInChargeOf)
+			agent.mCells[convertTo1D(mFloorField.mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
+	}
+	if (isBounded) // only cells around the obstacle and the volunteer are queried by moveVolunteer()
+		mFloorField.evaluateCells_bounded(agent.mDest, { mFloorField.mPool_o[agent.mInChargeOf].mPos, agent.mPos }, agent.mCells);
+	else
+		mFloorField.evaluateCells(agent.mDest, agent.mCells);
+}
 
-		int totalSize = 0;
-		std::for_each(mFloorField.mExits.begin(), mFloorField.mExits.end(), [&](const Exit &exit) { totalSize += exit.mPos.size(); });
-		for (const auto &exit : mFloorField.mExits) {
-			float offset_hv = exp(-1.f * exit.mPos.size() / totalSize);
-			for (const auto &e : exit.mPos) {
-				agent.mCells[convertTo1D(e)] = cells_e[convertTo1D(e)] = EXIT_WEIGHT;
-				mFloorField.evaluateCells(convertTo1D(e), agent.mCells);
-				mFloorField.evaluateCells(convertTo1D(e), cells_e, offset_hv);
-			}
-		}
+void ObstacleRemovalModel::customizeFloorField(const id_set &blacklist, CustomFloorField &field) const {
+	assert(!blacklist.empty() && "Error when customizing the floor field");
+	field.mCellsStatic.assign(mFloorField.mDim[0] * mFloorField.mDim[1], INIT_WEIGHT);
+	field.mCellsStatic_e.assign(mFloorField.mDim[0] * mFloorField.mDim[1], INIT_WEIGHT);
 
-		for (size_t i = 0; i < agent.mCells.size(); i++) {
-			if (!(agent.mCells[i] == INIT_WEIGHT || agent.mCells[i] == OBSTACLE_WEIGHT))
-				agent.mCells[i] = -mFloorField.mKS * agent.mCells[i] + mFloorField.mKD * mFloorField.mCellsDynamic[i] - mFloorField.mKE * cells_e[i];
-			agent.mCells[i] -= mKA * mCellsAnticipation[i];
+	for (const auto &i : blacklist)
+		field.mCellsStatic[convertTo1D(mFloorField.mPool_o[i].mPos)] = field.mCellsStatic_e[convertTo1D(mFloorField.mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
+	for (const auto &i : mFloorField.mActiveObstacles) {
+		if (mFloorField.mPool_o[i].mIsMovable && !mFloorField.mPool_o[i].mIsAssigned)
+			continue;
+		field.mCellsStatic[convertTo1D(mFloorField.mPool_o[i].mPos)] = field.mCellsStatic_e[convertTo1D(mFloorField.mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
+	}
+
+	int totalSize = 0;
+	std::for_each(mFloorField.mExits.begin(), mFloorField.mExits.end(), [&](const Exit &exit) { totalSize += exit.mPos.size(); });
+	for (const auto &exit : mFloorField.mExits) {
+		float offset_hv = exp(-1.f * exit.mPos.size() / totalSize);
+		for (const auto &e : exit.mPos) {
+			field.mCellsStatic[convertTo1D(e)] = field.mCellsStatic_e[convertTo1D(e)] = EXIT_WEIGHT;
+			mFloorField.evaluateCells(convertTo1D(e), field.mCellsStatic);
+			mFloorField.evaluateCells(convertTo1D(e), field.mCellsStatic_e, offset_hv);
 		}
 	}
 }
 
-void ObstacleRemovalModel::syncFloorFieldForEvacuees() {
+void ObstacleRemovalModel::setCustomFloorFieldsForEvacuees(std::vector<std::pair<const id_set, CustomFloorField> *> &toDoList) {
+	if (mFlgUpdateCustomFF) {
+		mCustomFloorFields.clear();
+		mFlgUpdateCustomFF = false;
+	}
+
+	/*
+	 * Keep the fields that are still referred to by some evacuee, and add the ones for new blacklists.
+	 * The dynamic floor field and the AFF are combined with them on demand in moveEvacuee().
+	 */
+	std::unordered_map<id_set, CustomFloorField, id_set::hasher> customFloorFields;
 	for (const auto &i : mAgentManager.mActiveAgents) {
-		if (!mAgentManager.mPool[i].mBlacklist.empty() && mAgentManager.mPool[i].mCompanion != STATE_NULL) {
-			mAgentManager.mPool[i].mCells.resize(mFloorField.mDim[0] * mFloorField.mDim[1]);
-			std::copy(mAgentManager.mPool[mAgentManager.mPool[i].mCompanion].mCells.begin(), mAgentManager.mPool[mAgentManager.mPool[i].mCompanion].mCells.end(), mAgentManager.mPool[i].mCells.begin());
-		}
+		const Agent &agent = mAgentManager.mPool[i];
+		if (agent.mInChargeOf != STATE_NULL || agent.mBlacklist.empty())
+			continue;
+
+		if (customFloorFields.find(agent.mBlacklist) != customFloorFields.end())
+			continue;
+
+		std::unordered_map<id_set, CustomFloorField, id_set::hasher>::iterator j = mCustomFloorFields.find(agent.mBlacklist);
+		if (j != mCustomFloorFields.end())
+			customFloorFields[agent.mBlacklist] = std::move(j->second);
+		else
+			customFloorFields[agent.mBlacklist];
 	}
-}
+	mCustomFloorFields.swap(customFloorFields);
 
-void ObstacleRemovalModel::setCompanionForEvacuees() {
-	std::for_each(mAgentManager.mActiveAgents.begin(), mAgentManager.mActiveAgents.end(),
-		[&](int i) { std::sort(mAgentManager.mPool[i].mBlacklist.begin(), mAgentManager.mPool[i].mBlacklist.end()); mAgentManager.mPool[i].mCompanion = STATE_NULL; });
-	for (size_t i_ = 0; i_ < mAgentManager.mActiveAgents.size(); i_++) {
-		int i = mAgentManager.mActiveAgents[i_];
-		if (!mAgentManager.mPool[i].mBlacklist.empty() && mAgentManager.mPool[i].mCompanion == STATE_NULL) {
-			for (size_t j_ = i_ + 1; j_ < mAgentManager.mActiveAgents.size(); j_++) {
-				int j = mAgentManager.mActiveAgents[j_];
-				if (!mAgentManager.mPool[j].mBlacklist.empty() && mAgentManager.mPool[j].mCompanion == STATE_NULL &&
-					std::equal(mAgentManager.mPool[i].mBlacklist.begin(), mAgentManager.mPool[i].mBlacklist.end(), mAgentManager.mPool[j].mBlacklist.begin(), mAgentManager.mPool[j].mBlacklist.end()))
-					mAgentManager.mPool[j].mCompanion = i;
-			}
-		}
+	toDoList.clear();
+	for (auto &field : mCustomFloorFields) {
+		if (field.second.mCellsStatic.empty())
+			toDoList.push_back(&field);
 	}
 }
 
@@ -955,109 +972,221 @@ void ObstacleRemovalModel::setMovableObstacleMap() {
 		if (mAgentManager.mPool[i].mInChargeOf != STATE_NULL)
 			mMovableObstacleMap[convertTo1D(mFloorField.mPool_o[mAgentManager.mPool[i].mInChargeOf].mPos)] = i;
 	}
+
+	setDropOffCells();
+	setExitNeighbors();
 }
 
-void ObstacleRemovalModel::setAFF() {
-	int r = (int)ceil(mInfluenceRadius);
+void ObstacleRemovalModel::setDropOffCells() {
+	std::fill(mNumObsNeighbors.begin(), mNumObsNeighbors.end(), 0);
+	mDropOffCells.clear();
+
+	for (size_t i = 0; i < mCellStates.size(); i++) {
+		if (mCellStates[i] == TYPE_IMMOVABLE_OBSTACLE || mMovableObstacleMap[i] == STATE_DONE)
+			addObsNeighbor(i);
+	}
+}
+
+void ObstacleRemovalModel::addObsNeighbor(int index) {
+	array2i cell = { index % mFloorField.mDim[0], index / mFloorField.mDim[0] };
+
+	for (int y = -1; y < 2; y++) {
+		for (int x = -1; x < 2; x++) {
+			if (y == 0 && x == 0)
+				continue;
+
+			if (isWithinBoundary(cell[0] + x, cell[1] + y)) {
+				int adjIndex = convertTo1D(cell[0] + x, cell[1] + y);
+				if (++mNumObsNeighbors[adjIndex] == 3)
+					mDropOffCells.insert(adjIndex);
+			}
+		}
+	}
+}
+
+void ObstacleRemovalModel::setExitNeighbors() {
+	mExitNeighbors.assign(mFloorField.mExits.size(), arrayNi());
+	mNumBlockingObstacles.assign(mFloorField.mExits.size(), 0);
+	std::fill(mExitToBlock.begin(), mExitToBlock.end(), STATE_NULL);
+
+	for (size_t i = 0; i < mFloorField.mExits.size(); i++) {
+		const Exit &exit = mFloorField.mExits[i];
+		arrayNi &neighbors = mExitNeighbors[i];
+
+		for (const auto &e : exit.mPos) {
+			for (int y = -1; y < 2; y++) {
+				for (int x = -1; x < 2; x++) {
+					if (!isWithinBoundary(e[0] + x, e[1] + y))
+						continue;
+
+					int adjIndex = convertTo1D(e[0] + x, e[1] + y);
+					if (mExitToBlock[adjIndex] == STATE_NULL) // an obstacle here exactly blocks the exit
+						mExitToBlock[adjIndex] = i;
 
+					if (!(y == 0 && x == 0) &&
+						mCellStates[adjIndex] != TYPE_IMMOVABLE_OBSTACLE &&
+						std::find(exit.mPos.begin(), exit.mPos.end(), array2i{ e[0] + x, e[1] + y }) == exit.mPos.end())
+						neighbors.push_back(adjIndex);
+				}
+			}
+		}
+
+		std::sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+		mNumBlockingObstacles[i] = std::count_if(neighbors.begin(), neighbors.end(), [&](int j) { return mCellStates[j] == TYPE_MOVABLE_OBSTACLE; });
+	}
+}
+
+void ObstacleRemovalModel::moveBlockingObstacle(int from, int to) {
+	for (size_t i = 0; i < mExitNeighbors.size(); i++) {
+		if (std::binary_search(mExitNeighbors[i].begin(), mExitNeighbors[i].end(), from))
+			mNumBlockingObstacles[i]--;
+		if (std::binary_search(mExitNeighbors[i].begin(), mExitNeighbors[i].end(), to))
+			mNumBlockingObstacles[i]++;
+	}
+}
+
+void ObstacleRemovalModel::setAFF() {
 	std::fill(mCellsAnticipation.begin(), mCellsAnticipation.end(), 0.f);
 	for (const auto &i : mAgentManager.mActiveAgents) {
 		if (mAgentManager.mPool[i].mInChargeOf != STATE_NULL) {
 			Agent &agent = mAgentManager.mPool[i];
-			array2f dir_ao = norm(agent.mPos, mFloorField.mPool_o[agent.mInChargeOf].mPos), dir_ac;
-			int index;
+			const array2i &obstaclePos = mFloorField.mPool_o[agent.mInChargeOf].mPos;
+
+			for (const auto &entry : getAFFKernel(array2i{ obstaclePos[0] - agent.mPos[0], obstaclePos[1] - agent.mPos[1] })) {
+				int x = agent.mPos[0] + entry[0], y = agent.mPos[1] + entry[1];
+				if (isWithinBoundary(x, y)) {
+					int index = convertTo1D(x, y);
+					if (mCellStates[index] == TYPE_EMPTY || mCellStates[index] == TYPE_AGENT)
+						mCellsAnticipation[index] += entry[2];
+				}
+			}
+		}
+	}
+}
 
-			for (int y = -r; y <= r; y++) {
-				for (int x = -r; x <= r; x++) {
-					if (y == 0 && x == 0)
-						continue;
+const std::vector<array3i> &ObstacleRemovalModel::getAFFKernel(const array2i &offset) {
+	if (mAFFKernels.empty() || mAFFKernelParams != array2f{ mInfluenceRadius, mFloorField.mLambda }) {
+		mAFFKernels.clear();
+		mAFFKernelParams = { mInfluenceRadius, mFloorField.mLambda };
+	}
 
-					index = convertTo1D(agent.mPos[0] + x, agent.mPos[1] + y);
-					if (isWithinBoundary(agent.mPos[0] + x, agent.mPos[1] + y) &&
-						(mCellStates[index] == TYPE_EMPTY || mCellStates[index] == TYPE_AGENT)) {
-						dir_ac = norm(agent.mPos, array2i{ agent.mPos[0] + x, agent.mPos[1] + y });
-						if (dir_ao[0] * dir_ac[0] + dir_ao[1] * dir_ac[1] < cosd(45.f)) {
-							float dist = calcVecLen(abs(x), abs(y));
-							if (dist * 6.f <= mInfluenceRadius)
-								mCellsAnticipation[index] += 3.f;
-							else if (dist * 3.f <= mInfluenceRadius)
-								mCellsAnticipation[index] += 2.f;
-							else if (dist * 2.f <= mInfluenceRadius)
-								mCellsAnticipation[index] += 1.f;
-						}
-						else {
-							float dist = calcVecLen(abs(agent.mPos[0] + x - mFloorField.mPool_o[agent.mInChargeOf].mPos[0]), abs(agent.mPos[1] + y - mFloorField.mPool_o[agent.mInChargeOf].mPos[1]));
-							if (dist * 3.f <= mInfluenceRadius)
-								mCellsAnticipation[index] += 3.f;
-							else if (dist * 3.f <= mInfluenceRadius * 2.f)
-								mCellsAnticipation[index] += 2.f;
-							else if (dist <= mInfluenceRadius)
-								mCellsAnticipation[index] += 1.f;
-						}
-					}
-				}
+	auto it = mAFFKernels.find(offset);
+	if (it != mAFFKernels.end())
+		return it->second;
+
+	/*
+	 * Build the kernel with the volunteer at the origin and the obstacle at offset. Entries are sorted by the y offset (setAFF_tbb() relies on it).
+	 */
+	std::vector<array3i> &kernel = mAFFKernels[offset];
+	int r = (int)ceil(mInfluenceRadius);
+	array2f dir_ao = norm(array2i{ 0, 0 }, offset), dir_ac;
+
+	for (int y = -r; y <= r; y++) {
+		for (int x = -r; x <= r; x++) {
+			if (y == 0 && x == 0)
+				continue;
+
+			int increment = 0;
+			dir_ac = norm(array2i{ 0, 0 }, array2i{ x, y });
+			if (dir_ao[0] * dir_ac[0] + dir_ao[1] * dir_ac[1] < cosd(45.f)) {
+				float dist = calcVecLen(abs(x), abs(y));
+				if (dist * 6.f <= mInfluenceRadius)
+					increment = 3;
+				else if (dist * 3.f <= mInfluenceRadius)
+					increment = 2;
+				else if (dist * 2.f <= mInfluenceRadius)
+					increment = 1;
 			}
+			else {
+				float dist = calcVecLen(abs(x - offset[0]), abs(y - offset[1]));
+				if (dist * 3.f <= mInfluenceRadius)
+					increment = 3;
+				else if (dist * 3.f <= mInfluenceRadius * 2.f)
+					increment = 2;
+				else if (dist <= mInfluenceRadius)
+					increment = 1;
+			}
+			if (increment > 0)
+				kernel.push_back(array3i{ x, y, increment });
 		}
 	}
+	return kernel;
 }
 
 void ObstacleRemovalModel::calcDensity() {
-	int r = (int)ceil(mInterferenceRadius);
+	setInterferenceStencil();
+	setOccupancySums();
+
+	int rowSize = mFloorField.mDim[0] + 1;
 	for (const auto &i : mFloorField.mActiveObstacles) {
 		if (mFloorField.mPool_o[i].mIsMovable && mMovableObstacleMap[convertTo1D(mFloorField.mPool_o[i].mPos)] != STATE_DONE) {
 			Obstacle &obstacle = mFloorField.mPool_o[i];
-			int adjIndex, numEvacuees = 0, numNonObsCells = 0;
-			for (int y = -r; y <= r; y++) {
-				for (int x = -r; x <= r; x++) {
-					if (y == 0 && x == 0)
-						continue;
+			int numEvacuees = 0, numNonObsCells = 0;
+			for (const auto &span : mInterferenceStencil) {
+				int y = obstacle.mPos[1] + span[0];
+				int x0 = std::max(obstacle.mPos[0] + span[1], 0), x1 = std::min(obstacle.mPos[0] + span[2], mFloorField.mDim[0] - 1);
+				if (y < 0 || y >= mFloorField.mDim[1] || x0 > x1)
+					continue;
 
-					adjIndex = convertTo1D(obstacle.mPos[0] + x, obstacle.mPos[1] + y);
-					if (isWithinBoundary(obstacle.mPos[0] + x, obstacle.mPos[1] + y) &&
-						isWithinInterferenceArea(obstacle.mPos, array2i{ obstacle.mPos[0] + x, obstacle.mPos[1] + y }) &&
-						!(mCellStates[adjIndex] == TYPE_MOVABLE_OBSTACLE || mCellStates[adjIndex] == TYPE_IMMOVABLE_OBSTACLE)) {
-						if (mCellStates[adjIndex] == TYPE_AGENT &&
-							mAgentManager.mPool[mAgentManager.mActiveAgents[*mAgentManager.isExisting(array2i{ obstacle.mPos[0] + x, obstacle.mPos[1] + y })]].mInChargeOf == STATE_NULL)
-							numEvacuees++;
-						numNonObsCells++;
-					}
-				}
+				numEvacuees += mNumEvacueesSums[y * rowSize + x1 + 1] - mNumEvacueesSums[y * rowSize + x0];
+				numNonObsCells += mNumNonObsCellsSums[y * rowSize + x1 + 1] - mNumNonObsCellsSums[y * rowSize + x0];
 			}
+
+			// exclude the cell occupied by the obstacle itself
+			int index = obstacle.mPos[1] * rowSize + obstacle.mPos[0];
+			numEvacuees -= mNumEvacueesSums[index + 1] - mNumEvacueesSums[index];
+			numNonObsCells -= mNumNonObsCellsSums[index + 1] - mNumNonObsCellsSums[index];
+
 			obstacle.mDensities.push((float)numEvacuees / numNonObsCells);
 		}
 	}
 }
 
-float ObstacleRemovalModel::calcBlockedProportion(const Obstacle &obstacle) const {
-	for (const auto &exit : mFloorField.mExits) {
-		bool isBlocked = false;
-		for (const auto &e : exit.mPos) {
-			if (abs(obstacle.mPos[0] - e[0]) <= 1 && abs(obstacle.mPos[1] - e[1]) <= 1) // the obstacle exactly blocks the exit
-				isBlocked = true;
+void ObstacleRemovalModel::setInterferenceStencil() {
+	if (!mInterferenceStencil.empty() && mStencilParams == array2f{ mInterferenceRadius, mFloorField.mLambda })
+		return;
+
+	int r = (int)ceil(mInterferenceRadius);
+	mInterferenceStencil.clear();
+	for (int y = -r; y <= r; y++) {
+		for (int x = -r; x <= r; x++) {
+			if (!isWithinInterferenceArea(array2i{ 0, 0 }, array2i{ x, y }))
+				continue;
+
+			if (!mInterferenceStencil.empty() && mInterferenceStencil.back()[0] == y && mInterferenceStencil.back()[2] == x - 1)
+				mInterferenceStencil.back()[2] = x; // extend the current span
+			else
+				mInterferenceStencil.push_back(array3i{ y, x, x });
 		}
+	}
+	mStencilParams = { mInterferenceRadius, mFloorField.mLambda };
+}
 
-		if (isBlocked) {
-			arrayNi neighbors;
-			for (const auto &e : exit.mPos) {
-				int adjIndex;
-				for (int y = -1; y < 2; y++) {
-					for (int x = -1; x < 2; x++) {
-						if (y == 0 && x == 0)
-							continue;
-
-						adjIndex = convertTo1D(e[0] + x, e[1] + y);
-						if (isWithinBoundary(e[0] + x, e[1] + y) &&
-							mCellStates[adjIndex] != TYPE_IMMOVABLE_OBSTACLE &&
-							std::find(exit.mPos.begin(), exit.mPos.end(), array2i{ e[0] + x, e[1] + y }) == exit.mPos.end() &&
-							!find(neighbors, adjIndex))
-							neighbors.push_back(adjIndex);
-					}
-				}
-			}
-			return (float)std::count_if(neighbors.begin(), neighbors.end(), [&](int i) { return mCellStates[i] == TYPE_MOVABLE_OBSTACLE; }) / neighbors.size();
+void ObstacleRemovalModel::setOccupancySums() {
+	int rowSize = mFloorField.mDim[0] + 1;
+	mNumNonObsCellsSums.assign(rowSize * mFloorField.mDim[1], 0);
+	mNumEvacueesSums.assign(rowSize * mFloorField.mDim[1], 0);
+
+	for (const auto &i : mAgentManager.mActiveAgents) {
+		if (mAgentManager.mPool[i].mInChargeOf == STATE_NULL && mCellStates[convertTo1D(mAgentManager.mPool[i].mPos)] == TYPE_AGENT)
+			mNumEvacueesSums[mAgentManager.mPool[i].mPos[1] * rowSize + mAgentManager.mPool[i].mPos[0] + 1] = 1;
+	}
+	for (int y = 0; y < mFloorField.mDim[1]; y++) {
+		for (int x = 0; x < mFloorField.mDim[0]; x++) {
+			int index = convertTo1D(x, y);
+			int isNonObsCell = !(mCellStates[index] == TYPE_MOVABLE_OBSTACLE || mCellStates[index] == TYPE_IMMOVABLE_OBSTACLE);
+			mNumNonObsCellsSums[y * rowSize + x + 1] = mNumNonObsCellsSums[y * rowSize + x] + isNonObsCell;
+			mNumEvacueesSums[y * rowSize + x + 1] += mNumEvacueesSums[y * rowSize + x];
 		}
 	}
-	return 0.f;
+}
+
+float ObstacleRemovalModel::calcBlockedProportion(const Obstacle &obstacle) const {
+	int i = mExitToBlock[convertTo1D(obstacle.mPos)];
+	if (i == STATE_NULL)
+		return 0.f;
+	return (float)mNumBlockingObstacles[i] / mExitNeighbors[i].size();
 }
 
 int ObstacleRemovalModel::getFreeCell_if(const arrayNf &cells, const array2i &pos1, const array2i &pos2,
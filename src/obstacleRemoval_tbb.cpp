@@ -1,64 +1,73 @@
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
+#include <tbb/partitioner.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/flow_graph.h>
 
 #include "obstacleRemoval.h"
 
+static tbb::enumerable_thread_specific<FloorField::SearchBuffer> searchBuffers; // reused by every call of CustomizeFloorField
+
 struct CustomizeFloorField {
 	const FloorField *mFloorField;
 	AgentManager *mAgentManager;
-	float mKA;
-	const arrayNf *mCellsAnticipation;
-	std::function<bool(const Agent &)> cond;
+	const arrayNi *mVolunteers;
 
 	void operator() (const tbb::blocked_range<int> &r) const {
-		for (size_t i = r.begin(); i != r.end(); i++) {
-			if (cond((*mAgentManager).mPool[(*mAgentManager).mActiveAgents[i]]))
-				customizeFloorField((*mAgentManager).mPool[(*mAgentManager).mActiveAgents[i]]);
-		}
+		for (size_t i = r.begin(); i != r.end(); i++)
+			customizeFloorField((*mAgentManager).mPool[(*mVolunteers)[i]]);
 	}
 
 	void customizeFloorField(Agent &agent) const {
-		assert(((agent.mInChargeOf != STATE_NULL && agent.mDest != STATE_NULL) || !agent.mBlacklist.empty()) && "Error when customizing the floor field");
+		assert(agent.mInChargeOf != STATE_NULL && agent.mDest != STATE_NULL && "Error when customizing the floor field");
 		agent.mCells.resize((*mFloorField).mDim[0] * (*mFloorField).mDim[1]);
 		std::fill(agent.mCells.begin(), agent.mCells.end(), INIT_WEIGHT);
 
-		if (agent.mInChargeOf != STATE_NULL) { // for volunteers
-			agent.mCells[agent.mDest] = EXIT_WEIGHT;
-			for (const auto &exit : (*mFloorField).mExits) {
-				for (const auto &e : exit.mPos)
-					agent.mCells[convertTo1D(e)] = OBSTACLE_WEIGHT;
-			}
-			for (const auto &i : (*mFloorField).mActiveObstacles) {
-				if (i != agent.mInChargeOf)
-					agent.mCells[convertTo1D((*mFloorField).mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
-			}
-			(*mFloorField).evaluateCells(agent.mDest, agent.mCells);
+		agent.mCells[agent.mDest] = EXIT_WEIGHT;
+		for (const auto &exit : (*mFloorField).mExits) {
+			for (const auto &e : exit.mPos)
+				agent.mCells[convertTo1D(e)] = OBSTACLE_WEIGHT;
 		}
-		else { // for evacuees
-			arrayNf cells_e(agent.mCells);
-			for (const auto &i : agent.mBlacklist)
-				agent.mCells[convertTo1D((*mFloorField).mPool_o[i].mPos)] = cells_e[convertTo1D((*mFloorField).mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
-			for (const auto &i : (*mFloorField).mActiveObstacles) {
-				if ((*mFloorField).mPool_o[i].mIsMovable && !(*mFloorField).mPool_o[i].mIsAssigned)
-					continue;
-				agent.mCells[convertTo1D((*mFloorField).mPool_o[i].mPos)] = cells_e[convertTo1D((*mFloorField).mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
-			}
+		for (const auto &i : (*mFloorField).mActiveObstacles) {
+			if (i != agent.mInChargeOf)
+				agent.mCells[convertTo1D((*mFloorField).mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
+		}
+		(*mFloorField).evaluateCells_bounded(agent.mDest, { (*mFloorField).mPool_o[agent.mInChargeOf].mPos, agent.mPos }, agent.mCells, searchBuffers.local());
+	}
 
-			int totalSize = 0;
-			std::for_each((*mFloorField).mExits.begin(), (*mFloorField).mExits.end(), [&](const Exit &exit) { totalSize += exit.mPos.size(); });
-			for (const auto &exit : (*mFloorField).mExits) {
-				float offset_hv = exp(-1.f * exit.mPos.size() / totalSize);
-				for (const auto &e : exit.mPos) {
-					agent.mCells[convertTo1D(e)] = cells_e[convertTo1D(e)] = EXIT_WEIGHT;
-					(*mFloorField).evaluateCells(convertTo1D(e), agent.mCells);
-					(*mFloorField).evaluateCells(convertTo1D(e), cells_e, offset_hv);
-				}
-			}
+	inline int convertTo1D(const array2i &coord) const { return coord[1] * (*mFloorField).mDim[0] + coord[0]; }
+};
+
+struct CustomizeFloorFieldForEvacuees {
+	const FloorField *mFloorField;
+	const std::vector<std::pair<const id_set, CustomFloorField> *> *mToDoList;
 
-			for (size_t i = 0; i < agent.mCells.size(); i++) {
-				if (!(agent.mCells[i] == INIT_WEIGHT || agent.mCells[i] == OBSTACLE_WEIGHT))
-					agent.mCells[i] = -(*mFloorField).mKS * agent.mCells[i] + (*mFloorField).mKD * (*mFloorField).mCellsDynamic[i] - (*mFloorField).mKE * cells_e[i];
-				agent.mCells[i] -= mKA * (*mCellsAnticipation)[i];
+	void operator() (const tbb::blocked_range<int> &r) const {
+		for (int i = r.begin(); i != r.end(); i++)
+			customizeFloorField((*mToDoList)[i]->first, (*mToDoList)[i]->second);
+	}
+
+	void customizeFloorField(const id_set &blacklist, CustomFloorField &field) const {
+		assert(!blacklist.empty() && "Error when customizing the floor field");
+		field.mCellsStatic.assign((*mFloorField).mDim[0] * (*mFloorField).mDim[1], INIT_WEIGHT);
+		field.mCellsStatic_e.assign((*mFloorField).mDim[0] * (*mFloorField).mDim[1], INIT_WEIGHT);
+
+		for (const auto &i : blacklist)
+			field.mCellsStatic[convertTo1D((*mFloorField).mPool_o[i].mPos)] = field.mCellsStatic_e[convertTo1D((*mFloorField).mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
+		for (const auto &i : (*mFloorField).mActiveObstacles) {
+			if ((*mFloorField).mPool_o[i].mIsMovable && !(*mFloorField).mPool_o[i].mIsAssigned)
+				continue;
+			field.mCellsStatic[convertTo1D((*mFloorField).mPool_o[i].mPos)] = field.mCellsStatic_e[convertTo1D((*mFloorField).mPool_o[i].mPos)] = OBSTACLE_WEIGHT;
+		}
+
+		int totalSize = 0;
+		std::for_each((*mFloorField).mExits.begin(), (*mFloorField).mExits.end(), [&](const Exit &exit) { totalSize += exit.mPos.size(); });
+		for (const auto &exit : (*mFloorField).mExits) {
+			float offset_hv = exp(-1.f * exit.mPos.size() / totalSize);
+			for (const auto &e : exit.mPos) {
+				field.mCellsStatic[convertTo1D(e)] = field.mCellsStatic_e[convertTo1D(e)] = EXIT_WEIGHT;
+				(*mFloorField).evaluateCells(convertTo1D(e), field.mCellsStatic);
+				(*mFloorField).evaluateCells(convertTo1D(e), field.mCellsStatic_e, offset_hv);
 			}
 		}
 	}
@@ -66,92 +75,159 @@ struct CustomizeFloorField {
 	inline int convertTo1D(const array2i &coord) const { return coord[1] * (*mFloorField).mDim[0] + coord[0]; }
 };
 
+struct SetAFF {
+	const FloorField *mFloorField;
+	const arrayNi *mCellStates;
+	arrayNf *mCellsAnticipation;
+	const std::vector<std::pair<array2i, const std::vector<array3i> *>> *mKernels; // volunteers' positions and their kernels
+
+	void operator() (const tbb::blocked_range<int> &r) const {
+		// each task only writes the rows in its range, and kernel entries are sorted by the y offset, so only the entries of those rows are visited
+		auto cond = [](const array3i &entry, int y) { return entry[1] < y; };
+		for (const auto &kernel : *mKernels) {
+			auto first = std::lower_bound(kernel.second->begin(), kernel.second->end(), r.begin() - kernel.first[1], cond);
+			auto last = std::lower_bound(first, kernel.second->end(), r.end() - kernel.first[1], cond);
+			for (auto it = first; it != last; ++it) {
+				const array3i &entry = *it;
+				int x = kernel.first[0] + entry[0], y = kernel.first[1] + entry[1];
+				if (x < 0 || x >= (*mFloorField).mDim[0])
+					continue;
+
+				int index = y * (*mFloorField).mDim[0] + x;
+				if ((*mCellStates)[index] == TYPE_EMPTY || (*mCellStates)[index] == TYPE_AGENT)
+					(*mCellsAnticipation)[index] += entry[2];
+			}
+		}
+	}
+};
+
 struct CalcDensity {
 	FloorField *mFloorField;
-	const AgentManager *mAgentManager;
-	const arrayNi *mCellStates;
 	const arrayNi *mMovableObstacleMap;
-	float mInterferenceRadius;
+	const std::vector<array3i> *mInterferenceStencil;
+	const arrayNi *mNumNonObsCellsSums, *mNumEvacueesSums;
 
-	void operator() (const tbb::blocked_range<int> &r_) const {
-		int r = (int)ceil(mInterferenceRadius);
-		for (size_t i = r_.begin(); i != r_.end(); i++) {
+	void operator() (const tbb::blocked_range<int> &r) const {
+		int rowSize = (*mFloorField).mDim[0] + 1;
+		for (size_t i = r.begin(); i != r.end(); i++) {
 			if ((*mFloorField).mPool_o[(*mFloorField).mActiveObstacles[i]].mIsMovable &&
 				(*mMovableObstacleMap)[convertTo1D((*mFloorField).mPool_o[(*mFloorField).mActiveObstacles[i]].mPos)] != STATE_DONE) {
 				Obstacle &obstacle = (*mFloorField).mPool_o[(*mFloorField).mActiveObstacles[i]];
-				int adjIndex, numEvacuees = 0, numNonObsCells = 0;
-				for (int y = -r; y <= r; y++) {
-					for (int x = -r; x <= r; x++) {
-						if (y == 0 && x == 0)
-							continue;
-
-						adjIndex = convertTo1D(obstacle.mPos[0] + x, obstacle.mPos[1] + y);
-						if (isWithinBoundary(obstacle.mPos[0] + x, obstacle.mPos[1] + y) &&
-							isWithinInterferenceArea(obstacle.mPos, array2i{ obstacle.mPos[0] + x, obstacle.mPos[1] + y }) &&
-							!((*mCellStates)[adjIndex] == TYPE_MOVABLE_OBSTACLE || (*mCellStates)[adjIndex] == TYPE_IMMOVABLE_OBSTACLE)) {
-							if ((*mCellStates)[adjIndex] == TYPE_AGENT &&
-								(*mAgentManager).mPool[(*mAgentManager).mActiveAgents[*(*mAgentManager).isExisting(array2i{ obstacle.mPos[0] + x, obstacle.mPos[1] + y })]].mInChargeOf == STATE_NULL)
-								numEvacuees++;
-							numNonObsCells++;
-						}
-					}
+				int numEvacuees = 0, numNonObsCells = 0;
+				for (const auto &span : *mInterferenceStencil) {
+					int y = obstacle.mPos[1] + span[0];
+					int x0 = std::max(obstacle.mPos[0] + span[1], 0), x1 = std::min(obstacle.mPos[0] + span[2], (*mFloorField).mDim[0] - 1);
+					if (y < 0 || y >= (*mFloorField).mDim[1] || x0 > x1)
+						continue;
+
+					numEvacuees += (*mNumEvacueesSums)[y * rowSize + x1 + 1] - (*mNumEvacueesSums)[y * rowSize + x0];
+					numNonObsCells += (*mNumNonObsCellsSums)[y * rowSize + x1 + 1] - (*mNumNonObsCellsSums)[y * rowSize + x0];
 				}
+
+				// exclude the cell occupied by the obstacle itself
+				int index = obstacle.mPos[1] * rowSize + obstacle.mPos[0];
+				numEvacuees -= (*mNumEvacueesSums)[index + 1] - (*mNumEvacueesSums)[index];
+				numNonObsCells -= (*mNumNonObsCellsSums)[index + 1] - (*mNumNonObsCellsSums)[index];
+
 				obstacle.mDensities.push((float)numEvacuees / numNonObsCells);
 			}
 		}
 	}
 
-	bool isWithinInterferenceArea(const array2i &obstacle, const array2i &pos) const {
-		int diff_x = abs(obstacle[0] - pos[0]);
-		int diff_y = abs(obstacle[1] - pos[1]);
-		return (std::min(diff_x, diff_y) * (*mFloorField).mLambda + abs(diff_x - diff_y)) <= mInterferenceRadius ? true : false;
-	}
-
-	inline int convertTo1D(int x, int y) const { return y * (*mFloorField).mDim[0] + x; }
 	inline int convertTo1D(const array2i &coord) const { return coord[1] * (*mFloorField).mDim[0] + coord[0]; }
-	inline bool isWithinBoundary(int x, int y) const { return x >= 0 && x < (*mFloorField).mDim[0] && y >= 0 && y < (*mFloorField).mDim[1]; }
 };
 
 void ObstacleRemovalModel::maintainDataAboutSceneChanges_tbb(int type) {
-	mFloorField.update_p(type);
-	setAFF();
-	std::transform(mFloorField.mCells.begin(), mFloorField.mCells.end(), mCellsAnticipation.begin(), mFloorField.mCells.begin(),
-		[=](float i, float j) { return i - mKA * j; });
-	setCompanionForEvacuees();
+	if (type != UPDATE_DYNAMIC)
+		mFlgUpdateCustomFF = true;
+
+	// only a few (clustered) agents are volunteers, so compact them and schedule one volunteer per task
+	arrayNi volunteers;
+	for (const auto &i : mAgentManager.mActiveAgents) {
+		if (mAgentManager.mPool[i].mInChargeOf != STATE_NULL)
+			volunteers.push_back(i);
+	}
 
-	// TBB part
 	CustomizeFloorField body;
 	body.mFloorField = &mFloorField;
 	body.mAgentManager = &mAgentManager;
-	body.mKA = mKA;
-	body.mCellsAnticipation = &mCellsAnticipation;
-	body.cond = [](const Agent &agent) { return agent.mInChargeOf != STATE_NULL || (!agent.mBlacklist.empty() && agent.mCompanion == STATE_NULL); };
-	tbb::parallel_for(tbb::blocked_range<int>(0, mAgentManager.mActiveAgents.size()), body);
+	body.mVolunteers = &volunteers;
+
+	/*
+	 * Run the stages as a dependency graph. Custom floor fields only depend on the scene,
+	 * so they overlap with the update of the floor field and the AFF, which are combined at last.
+	 *   update_p -----+
+	 *   setAFF_tbb ---+--> combine
+	 *   customize (volunteers)
+	 *   customize (evacuees)
+	 */
+	tbb::flow::graph g;
+	tbb::flow::broadcast_node<tbb::flow::continue_msg> start(g);
+	tbb::flow::continue_node<tbb::flow::continue_msg> updateFF(g, [&](const tbb::flow::continue_msg &) {
+		mFloorField.update_p(type); });
+	tbb::flow::continue_node<tbb::flow::continue_msg> setAFF(g, [&](const tbb::flow::continue_msg &) {
+		setAFF_tbb(); });
+	tbb::flow::continue_node<tbb::flow::continue_msg> combine(g, [&](const tbb::flow::continue_msg &) {
+		std::transform(mFloorField.mCells.begin(), mFloorField.mCells.end(), mCellsAnticipation.begin(), mFloorField.mCells.begin(),
+			[=](float i, float j) { return i - mKA * j; }); });
+	tbb::flow::continue_node<tbb::flow::continue_msg> customizeFF(g, [&](const tbb::flow::continue_msg &) {
+		tbb::parallel_for(tbb::blocked_range<int>(0, volunteers.size(), 1), body, tbb::simple_partitioner()); });
+	tbb::flow::continue_node<tbb::flow::continue_msg> customizeFFForEvacuees(g, [&](const tbb::flow::continue_msg &) {
+		customizeFloorFieldForEvacuees_tbb(); });
+
+	tbb::flow::make_edge(start, updateFF);
+	tbb::flow::make_edge(start, setAFF);
+	tbb::flow::make_edge(updateFF, combine);
+	tbb::flow::make_edge(setAFF, combine);
+	tbb::flow::make_edge(start, customizeFF);
+	tbb::flow::make_edge(start, customizeFFForEvacuees);
 
-	syncFloorFieldForEvacuees();
+	// TBB part
+	start.try_put(tbb::flow::continue_msg());
+	g.wait_for_all();
 }
 
-void ObstacleRemovalModel::customizeFloorFieldForEvacuees_tbb() {
-	setCompanionForEvacuees();
+void ObstacleRemovalModel::setAFF_tbb() {
+	std::fill(mCellsAnticipation.begin(), mCellsAnticipation.end(), 0.f);
+
+	// kernels are looked up (and built) serially since mAFFKernels is shared
+	std::vector<std::pair<array2i, const std::vector<array3i> *>> kernels;
+	for (const auto &i : mAgentManager.mActiveAgents) {
+		if (mAgentManager.mPool[i].mInChargeOf != STATE_NULL) {
+			const array2i &pos = mAgentManager.mPool[i].mPos, &obstaclePos = mFloorField.mPool_o[mAgentManager.mPool[i].mInChargeOf].mPos;
+			kernels.push_back(std::make_pair(pos, &getAFFKernel(array2i{ obstaclePos[0] - pos[0], obstaclePos[1] - pos[1] })));
+		}
+	}
 
 	// TBB part
-	CustomizeFloorField body;
+	SetAFF body;
 	body.mFloorField = &mFloorField;
-	body.mAgentManager = &mAgentManager;
-	body.mKA = mKA;
+	body.mCellStates = &mCellStates;
 	body.mCellsAnticipation = &mCellsAnticipation;
-	body.cond = [](const Agent &agent) { return !agent.mBlacklist.empty() && agent.mCompanion == STATE_NULL; };
-	tbb::parallel_for(tbb::blocked_range<int>(0, mAgentManager.mActiveAgents.size()), body);
+	body.mKernels = &kernels;
+	tbb::parallel_for(tbb::blocked_range<int>(0, mFloorField.mDim[1]), body);
+}
 
-	syncFloorFieldForEvacuees();
+void ObstacleRemovalModel::customizeFloorFieldForEvacuees_tbb() {
+	std::vector<std::pair<const id_set, CustomFloorField> *> toDoList;
+	setCustomFloorFieldsForEvacuees(toDoList);
+
+	// TBB part
+	CustomizeFloorFieldForEvacuees body;
+	body.mFloorField = &mFloorField;
+	body.mToDoList = &toDoList;
+	tbb::parallel_for(tbb::blocked_range<int>(0, toDoList.size()), body);
 }
 
 void ObstacleRemovalModel::calcDensity_tbb() {
+	setInterferenceStencil();
+	setOccupancySums();
+
 	CalcDensity body;
 	body.mFloorField = &mFloorField;
-	body.mAgentManager = &mAgentManager;
-	body.mCellStates = &mCellStates;
 	body.mMovableObstacleMap = &mMovableObstacleMap;
-	body.mInterferenceRadius = mInterferenceRadius;
+	body.mInterferenceStencil = &mInterferenceStencil;
+	body.mNumNonObsCellsSums = &mNumNonObsCellsSums;
+	body.mNumEvacueesSums = &mNumEvacueesSums;
 	tbb::parallel_for(tbb::blocked_range<int>(0, mFloorField.mActiveObstacles.size()), body);
 }
\ No newline at end of file
@@ -1,4 +1,6 @@
- #include "testApp.h"
+ #include "boost/math/distributions/students_t.hpp"
+
+#include "testApp.h"
 
 TestApp::TestApp() {
 	read("./data/config_test.txt");
@@ -8,10 +10,37 @@ void TestApp::read(const char *fileName) {
 	std::ifstream ifs(fileName, std::ios::in);
 	assert(ifs.good());
 
+	mRandomSeed = std::random_device{}();
+	mFlushInterval = 16;
+	mMinExpts = 0;
+	mCIHalfWidth = 0.f;
+	mLeaseTime = 600;
+	mAroundVolunteersDist = 5.f;
 	std::string key;
 	while (ifs >> key) {
 		if (key.compare("NUM_EXPERIMENTS") == 0)
 			ifs >> mNumExpts;
+		else if (key.compare("RANDOM_SEED") == 0) {
+			long long randomSeed;
+			ifs >> randomSeed;
+			if (randomSeed != -1)
+				mRandomSeed = (unsigned int)randomSeed;
+		}
+		else if (key.compare("FLUSH_INTERVAL") == 0)
+			ifs >> mFlushInterval;
+		else if (key.compare("MIN_EXPERIMENTS") == 0)
+			ifs >> mMinExpts;
+		else if (key.compare("CI_HALF_WIDTH") == 0)
+			ifs >> mCIHalfWidth;
+		else if (key.compare("SPOOL_DIR") == 0) {
+			ifs >> mSpoolDir;
+			if (mSpoolDir.compare("-") == 0)
+				mSpoolDir.clear();
+		}
+		else if (key.compare("LEASE_TIME") == 0)
+			ifs >> mLeaseTime;
+		else if (key.compare("AROUND_VOLUNTEERS") == 0)
+			ifs >> mAroundVolunteersDist;
 		else if (key.compare("CY_RANGE") == 0) {
 			int numCy;
 			ifs >> numCy;
@@ -50,6 +79,9 @@ void TestApp::read(const char *fileName) {
 }
 
 void TestApp::runTest() {
+	if (!mSpoolDir.empty() && !openSpool())
+		return;
+
 	time_t rawTime;
 	struct tm timeInfo;
 	char buffer[15];
@@ -58,69 +90,286 @@ void TestApp::runTest() {
 	strftime(buffer, 15, "%y%m%d%H%M%S", &timeInfo);
 	std::ofstream ofs("./result/result_" + std::string(buffer) + ".csv", std::ios::out);
 
-	arrayNi timesteps(mNumExpts);
-	arrayNf avgTravelTimesteps(mNumExpts);
-	arrayNi numEvacuees(mNumExpts), numVolunteers(mNumExpts), maxTravelTS_e(mNumExpts), minTravelTS_e(mNumExpts);
-	arrayNf avgTravelTS_e(mNumExpts), avgTravelTS_v(mNumExpts);
-	char parameters[300], record[300];
+	std::vector<Job> jobs;
+	setJobs(jobs);
+	arrayNi timesteps(jobs.size());
+	arrayNf avgTravelTimesteps(jobs.size());
+	std::vector<VolunteerStats> volunteerStats(jobs.size());
+	char parameters[300], record[300], stats[300];
 
-	auto cond_travelTs = [](int i, const Agent &j) { return i + j.mTravelTimesteps; };
+	/*
+	 * Skip the jobs recorded in the job file, and append the others to it as they finish.
+	 *  Use the same RANDOM_SEED to resume a sweep.
+	 */
+	std::string jobFileName = "./result/jobs_" + std::to_string(mRandomSeed) + ".csv";
+	arrayNb isDone(jobs.size(), false);
+	bool isComplete = readJobs(jobFileName, jobs, isDone, timesteps, avgTravelTimesteps, volunteerStats);
+
+	cout << "Random seed: " << mRandomSeed << " (" << std::count(isDone.begin(), isDone.end(), true) << " job(s) done in " << jobFileName << ")" << endl;
+
+	std::ofstream ofs_jobs(jobFileName, std::ios::out | std::ios::app);
+	if (!isComplete)
+		ofs_jobs << endl; // terminate the line cut off by a crash
+
+	/*
+	 * Run the experiments in rounds.
+	 *  Without CI_HALF_WIDTH, every parameter tuple runs NUM_EXPERIMENTS experiments in one round. Otherwise, every parameter tuple starts with MIN_EXPERIMENTS experiments,
+	 *  and gets more until the half-width of the 95% confidence interval of the mean evacuation time is within CI_HALF_WIDTH, or NUM_EXPERIMENTS is reached.
+	 *  Tuple t always uses its first numRuns[t] experiments, so that every round can be resumed from the job file.
+	 */
+	bool isAdaptive = mCIHalfWidth > 0.f;
+	int numTuples = jobs.size() / mNumExpts;
+	arrayNi numRuns(numTuples, isAdaptive ? std::min(std::max(mMinExpts, 2), mNumExpts) : mNumExpts);
+	arrayNb isSettled(numTuples, false);
+	for (int round = 0; ; round++) {
+		arrayNi toDoList;
+		for (int t = 0; t < numTuples; t++) {
+			for (int i = t * mNumExpts; i < t * mNumExpts + numRuns[t]; i++) {
+				if (!isDone[i])
+					toDoList.push_back(i);
+			}
+		}
+		if (mSpoolDir.empty())
+			runExperiments_tbb(jobs, toDoList, timesteps, avgTravelTimesteps, volunteerStats, ofs_jobs); // every experiment is independent
+		else
+			runExperiments_spool(jobs, toDoList, timesteps, avgTravelTimesteps, volunteerStats, ofs_jobs); // worker processes run the experiments
+		for (const auto &i : toDoList)
+			isDone[i] = true;
+
+		if (!isAdaptive)
+			break;
+
+		int numUnsettled = 0;
+		for (int t = 0; t < numTuples; t++) {
+			if (isSettled[t])
+				continue;
+
+			if (numRuns[t] == mNumExpts) { // also covers NUM_EXPERIMENTS = 1, which has no confidence interval
+				isSettled[t] = true;
+				continue;
+			}
+
+			running_stat stat;
+			for (int i = t * mNumExpts; i < t * mNumExpts + numRuns[t]; i++)
+				stat.push(timesteps[i]);
+			double quantile = boost::math::quantile(boost::math::students_t(stat.count() - 1), 0.975);
+			double halfWidth = quantile * stat.stddev() / sqrt(stat.count());
+			if (halfWidth <= mCIHalfWidth) {
+				isSettled[t] = true;
+				continue;
+			}
+
+			// estimate the number of experiments that would be enough, using the current standard deviation
+			double estimate = ceil((quantile * stat.stddev() / mCIHalfWidth) * (quantile * stat.stddev() / mCIHalfWidth));
+			numRuns[t] = (int)std::min((double)mNumExpts, std::max(estimate, numRuns[t] + 1.0));
+			numUnsettled++;
+		}
+		cout << endl << "Round " << round << ": " << numUnsettled << " parameter tuple(s) need more experiments" << endl;
+		if (numUnsettled == 0)
+			break;
+	}
+	ofs_jobs.close();
+	if (!mSpoolDir.empty())
+		closeSpool();
+	cout << endl;
+
+	/*
+	 * Reduce the results of every parameter tuple into one row (followed by the number of experiments in the adaptive mode).
+	 *  The statistics about volunteers are the average numbers of evacuees and volunteers, their average travel timesteps over all experiments,
+	 *  and the maximum and minimum travel timesteps of evacuees.
+	 */
+	for (int t = 0; t < numTuples; t++) {
+		int first = t * mNumExpts, last = first + numRuns[t];
+		sprintf_s(parameters, "%.1f, %.1f, %3d, %.1f", jobs[first].mCy, jobs[first].mCv, jobs[first].mTTR, jobs[first].mD);
+		sprintf_s(record, "%.3f, %.3f, %.3f, %.3f",
+			mean(timesteps.begin() + first, timesteps.begin() + last), stddev(timesteps.begin() + first, timesteps.begin() + last),
+			mean(avgTravelTimesteps.begin() + first, avgTravelTimesteps.begin() + last), stddev(avgTravelTimesteps.begin() + first, avgTravelTimesteps.begin() + last));
+
+		int numEvacuees = 0, numVolunteers = 0, maxTravelTS_e = 0, minTravelTS_e = INT_MAX;
+		double totalTravelTS_e = 0.0, totalTravelTS_v = 0.0;
+		for (int i = first; i < last; i++) {
+			const VolunteerStats &stats = volunteerStats[i];
+			numEvacuees += stats.mNumEvacuees;
+			numVolunteers += stats.mNumVolunteers;
+			totalTravelTS_e += (double)stats.mAvgTravelTS_e * stats.mNumEvacuees;
+			totalTravelTS_v += (double)stats.mAvgTravelTS_v * stats.mNumVolunteers;
+			if (stats.mNumEvacuees > 0) {
+				maxTravelTS_e = std::max(maxTravelTS_e, stats.mMaxTravelTS_e);
+				minTravelTS_e = std::min(minTravelTS_e, stats.mMinTravelTS_e);
+			}
+		}
+		sprintf_s(stats, "%.3f, %.3f, %.3f, %.3f, %d, %d",
+			(double)numEvacuees / (last - first), (double)numVolunteers / (last - first),
+			numEvacuees > 0 ? totalTravelTS_e / numEvacuees : 0.0, numVolunteers > 0 ? totalTravelTS_v / numVolunteers : 0.0,
+			maxTravelTS_e, numEvacuees > 0 ? minTravelTS_e : 0);
+		ofs << parameters << ", " << record << ", " << stats;
+		cout << parameters << ", " << record << ", " << stats;
+		if (isAdaptive) {
+			ofs << ", " << numRuns[t];
+			cout << ", " << numRuns[t];
+		}
+		ofs << endl;
+		cout << endl;
+	}
+
+	ofs.close();
+
+	cout << "Save successfully: " << "./result/result_" + std::string(buffer) + ".csv" << endl;
+}
+
+void TestApp::setJobs(std::vector<Job> &jobs) const {
+	char key[300];
 
 	for (const auto &cy : mCyRange) {
 		for (const auto &cv : mCvRange) {
 			for (const auto &ttr : mTTRRange) {
 				for (const auto &d : mDRange) {
 					for (int i = 0; i < mNumExpts; i++) {
-						mModel.~ObstacleRemovalModel();
-						new (&mModel) ObstacleRemovalModel;
-						mModel.mCy = cy;
-						mModel.mCv = cv;
-						mModel.mTimestepToRemove = ttr;
-						mModel.mMinDistFromExits = d;
-
-						while (!mModel.mAgentManager.mActiveAgents.empty())
-							mModel.update();
-						timesteps[i] = mModel.mTimesteps;
-						avgTravelTimesteps[i] = (float)std::accumulate(mModel.mHistory.begin(), mModel.mHistory.end(), 0, cond_travelTs) / mModel.mHistory.size();
-						//countEvacueesAroundVolunteers(mModel.mHistory, 5.f, numEvacuees[i], numVolunteers[i], avgTravelTS_e[i], avgTravelTS_v[i], maxTravelTS_e[i], minTravelTS_e[i]);
-
-						cout << ".";
+						Job job;
+						job.mCy = cy;
+						job.mCv = cv;
+						job.mTTR = ttr;
+						job.mD = d;
+						job.mAroundVolunteersDist = mAroundVolunteersDist;
+						std::seed_seq seq{ mRandomSeed, (unsigned int)i };
+						seq.generate(job.mSeeds.begin(), job.mSeeds.end());
+						sprintf_s(key, "%g, %g, %d, %g, %u, %u, %g", cy, cv, ttr, d, job.mSeeds[0], job.mSeeds[1], mAroundVolunteersDist);
+						job.mKey = key;
+						jobs.push_back(job);
 					}
-
-					sprintf_s(parameters, "%.1f, %.1f, %3d, %.1f", cy, cv, ttr, d);
-					sprintf_s(record, "%.3f, %.3f, %.3f, %.3f",
-						mean(timesteps.begin(), timesteps.end()), stddev(timesteps.begin(), timesteps.end()),
-						mean(avgTravelTimesteps.begin(), avgTravelTimesteps.end()), stddev(avgTravelTimesteps.begin(), avgTravelTimesteps.end()));
-					ofs << parameters << ", " << record << endl;
-					cout << endl << parameters << ", " << record << endl;
 				}
 			}
 		}
 	}
+}
 
-	ofs.close();
+bool TestApp::readJobs(const std::string &fileName, const std::vector<Job> &jobs, arrayNb &isDone, arrayNi &timesteps, arrayNf &avgTravelTimesteps, std::vector<VolunteerStats> &volunteerStats) const {
+	std::ifstream ifs(fileName, std::ios::in);
+	if (!ifs.good())
+		return true;
 
-	cout << "Save successfully: " << "./result/result_" + std::string(buffer) + ".csv" << endl;
-	system("pause");
+	std::unordered_map<std::string, int> indices; // store the index in jobs of every key
+	for (size_t i = 0; i < jobs.size(); i++)
+		indices[jobs[i].mKey] = i;
+
+	/*
+	 * Every line is "key, timesteps, average travel timesteps, statistics about volunteers", and the key ends with AROUND_VOLUNTEERS, which the statistics depend on.
+	 *  A line without the line break was cut off by a crash, so it is ignored, and so is a line with another key or without the statistics about volunteers
+	 *  (written by an older version), so that the job is run again.
+	 */
+	std::string line;
+	bool isComplete = true;
+	while (std::getline(ifs, line)) {
+		if (ifs.eof()) {
+			isComplete = line.empty();
+			break;
+		}
+
+		size_t pos = line.find(", ");
+		for (int i = 0; i < 6 && pos != std::string::npos; i++)
+			pos = line.find(", ", pos + 2);
+		if (pos == std::string::npos)
+			continue;
+
+		auto result = indices.find(line.substr(0, pos));
+		if (result != indices.end() &&
+			readRecord(line.c_str() + pos, timesteps[result->second], avgTravelTimesteps[result->second], volunteerStats[result->second]))
+			isDone[result->second] = true;
+	}
+	ifs.close();
+
+	return isComplete;
+}
+
+bool TestApp::readRecord(const char *fields, int &timesteps, float &avgTravelTimesteps, VolunteerStats &stats) const {
+	int ts;
+	float avgTravelTs;
+	VolunteerStats s;
+	if (sscanf_s(fields, ", %d, %f, %d, %d, %f, %f, %d, %d", &ts, &avgTravelTs,
+		&s.mNumEvacuees, &s.mNumVolunteers, &s.mAvgTravelTS_e, &s.mAvgTravelTS_v, &s.mMaxTravelTS_e, &s.mMinTravelTS_e) != 8)
+		return false;
+
+	timesteps = ts;
+	avgTravelTimesteps = avgTravelTs;
+	stats = s;
+	return true;
+}
+
+std::string TestApp::runExperiment(const Job &job, ObstacleRemovalModel &model, int &timesteps, float &avgTravelTimesteps, VolunteerStats &stats,
+	const std::function<void()> &onUpdate) const {
+	auto cond_travelTs = [](int i, const Agent &j) { return i + j.mTravelTimesteps; };
+
+	model = mScene; // reuse the storage of the last experiment on model
+	model.reseed(job.mSeeds[0], job.mSeeds[1]);
+	model.mCy = job.mCy;
+	model.mCv = job.mCv;
+	model.mTimestepToRemove = job.mTTR;
+	model.mMinDistFromExits = job.mD;
+
+	while (!model.mAgentManager.mActiveAgents.empty()) {
+		model.update();
+		if (onUpdate)
+			onUpdate();
+	}
+	timesteps = model.mTimesteps;
+	avgTravelTimesteps = (float)std::accumulate(model.mHistory.begin(), model.mHistory.end(), 0, cond_travelTs) / model.mHistory.size();
+	countEvacueesAroundVolunteers(model.mHistory, job.mAroundVolunteersDist, stats.mNumEvacuees, stats.mNumVolunteers,
+		stats.mAvgTravelTS_e, stats.mAvgTravelTS_v, stats.mMaxTravelTS_e, stats.mMinTravelTS_e);
+
+	char record[300];
+	sprintf_s(record, "%s, %d, %.9g, %d, %d, %.9g, %.9g, %d, %d\n", job.mKey.c_str(), timesteps, avgTravelTimesteps,
+		stats.mNumEvacuees, stats.mNumVolunteers, stats.mAvgTravelTS_e, stats.mAvgTravelTS_v, stats.mMaxTravelTS_e, stats.mMinTravelTS_e);
+	return record;
+}
+
+void TestApp::runExperiments(const std::vector<Job> &jobs, const arrayNi &toDoList, arrayNi &timesteps, arrayNf &avgTravelTimesteps, std::vector<VolunteerStats> &volunteerStats, std::ofstream &ofs) const {
+	ObstacleRemovalModel model(mScene);
+
+	int numUnflushed = 0;
+	for (const auto &i : toDoList) {
+		ofs << runExperiment(jobs[i], model, timesteps[i], avgTravelTimesteps[i], volunteerStats[i]);
+		if (++numUnflushed == mFlushInterval) {
+			ofs.flush();
+			numUnflushed = 0;
+		}
+
+		cout << ".";
+	}
+	ofs.flush();
 }
 
 void TestApp::countEvacueesAroundVolunteers(const std::vector<Agent> &history, float dist, int &numEvacuees, int &numVolunteers,
 	float &avgTravelTS_e, float &avgTravelTS_v, int &maxTravelTS_e, int &minTravelTS_e) const {
+	/*
+	 * Index evacuees by their initial positions. Since min(x, y) * lambda + |x - y| >= max(x, y) * min(lambda, 1),
+	 *  evacuees around a volunteer are within the square of radius dist / min(lambda, 1).
+	 */
+	float lambda = mScene.mFloorField.mLambda;
+	int radius = (int)ceil(dist / std::min(lambda, 1.f));
+	bucket_grid evacuees(mScene.mFloorField.mDim, std::max(radius, 1));
+	for (size_t j = 0; j < history.size(); j++) {
+		if (!history[j].mHasVolunteerExperience)
+			evacuees.insert(history[j].mInitPos, j);
+	}
+
 	numVolunteers = 0;
 	avgTravelTS_v = 0.f;
 	maxTravelTS_e = 0;
 	minTravelTS_e = INT_MAX;
-	std::vector<Agent> buffer;
+	int totalTravelTS_e = 0;
+	id_set counted; // store indices (in history) of evacuees found around any volunteer
 	for (const auto &agent_i : history) {
 		if (agent_i.mHasVolunteerExperience) {
-			for (const auto &agent_j : history) { // find evacuees around volunteer agent_i
-				if (!agent_j.mHasVolunteerExperience &&
-					agent_i.mInitPos != agent_j.mInitPos &&
-					std::find_if(buffer.begin(), buffer.end(), [&](const Agent &agent_k) { return agent_j.mInitPos == agent_k.mInitPos; }) == buffer.end()) {
+			array2i lower = { agent_i.mInitPos[0] - radius, agent_i.mInitPos[1] - radius };
+			array2i upper = { agent_i.mInitPos[0] + radius, agent_i.mInitPos[1] + radius };
+			evacuees.query(lower, upper, [&](int j) { // find evacuees around volunteer agent_i
+				const Agent &agent_j = history[j];
+				if (agent_i.mInitPos != agent_j.mInitPos && !counted.contains(j)) {
 					int x = abs(agent_i.mInitPos[0] - agent_j.mInitPos[0]);
 					int y = abs(agent_i.mInitPos[1] - agent_j.mInitPos[1]);
-					if (std::min(x, y) * mModel.mFloorField.mLambda + abs(x - y) < dist) {
-						buffer.push_back(agent_j);
+					if (std::min(x, y) * lambda + abs(x - y) < dist) {
+						counted.insert(j);
+						totalTravelTS_e += agent_j.mTravelTimesteps;
 
 						if (agent_j.mTravelTimesteps > maxTravelTS_e)
 							maxTravelTS_e = agent_j.mTravelTimesteps;
@@ -128,12 +377,12 @@ void TestApp::countEvacueesAroundVolunteers(const std::vector<Agent> &history, f
 							minTravelTS_e = agent_j.mTravelTimesteps;
 					}
 				}
-			}
+			});
 			numVolunteers++;
 			avgTravelTS_v += (float)agent_i.mTravelTimesteps;
 		}
 	}
-	avgTravelTS_v /= numVolunteers;
-	numEvacuees = buffer.size();
-	avgTravelTS_e = (float)std::accumulate(buffer.begin(), buffer.end(), 0, [](int i, const Agent &j) { return i + j.mTravelTimesteps; }) / buffer.size();
+	numEvacuees = counted.size();
+	avgTravelTS_v = numVolunteers > 0 ? avgTravelTS_v / numVolunteers : 0.f; // 0 instead of NaN, which does not survive a round trip through the job file
+	avgTravelTS_e = numEvacuees > 0 ? (float)totalTravelTS_e / numEvacuees : 0.f;
 }
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include <thread>
+#include <sys/stat.h>
+
+#include "testApp.h"
+
+/*
+ * Layout of the spool directory (one sweep per directory):
+ *  sweep.txt       RANDOM_SEED and the number of jobs of the sweep
+ *  job_<i>.txt     queued job i (the scene fingerprint, the parameters including AROUND_VOLUNTEERS, and the key)
+ *  job_<i>.claimed job i renamed by the worker running it (the worker touches it to keep the claim)
+ *  job_<i>.csv     result of job i in the format of the job file
+ *  clock           rewritten by the coordinator on every poll, so that its modification time is the current time on the clock of the share
+ *  finished        created once the coordinator has every result, so that idle workers exit
+ *  Every file is written under a temporary name and renamed, so no process ever reads a partial file.
+ */
+
+static bool isExisting(const std::string &fileName) {
+	struct stat info;
+	return stat(fileName.c_str(), &info) == 0;
+}
+
+static void publish(const std::string &fileName, const std::string &contents, const std::string &tmpSuffix) {
+	std::string tmpFileName = fileName + tmpSuffix;
+	std::ofstream ofs(tmpFileName, std::ios::out);
+	ofs << contents;
+	ofs.close();
+	if (std::rename(tmpFileName.c_str(), fileName.c_str()) != 0) // the file already exists (on Windows)
+		std::remove(tmpFileName.c_str());
+}
+
+static time_t getShareTime(const std::string &spoolDir) {
+	FILE *fp;
+	if (fopen_s(&fp, (spoolDir + "clock").c_str(), "w") != 0)
+		return time(nullptr);
+	fprintf(fp, "%lld\n", (long long)time(nullptr));
+	fclose(fp);
+
+	struct stat info;
+	return stat((spoolDir + "clock").c_str(), &info) == 0 ? info.st_mtime : time(nullptr);
+}
+
+static unsigned long long getSceneFingerprint() {
+	const char *fileNames[] = { "./data/config_floorField.txt", "./data/config_agent.txt", "./data/config_obstacleRemoval.txt", "./data/config_agent_history.txt" };
+
+	unsigned long long hash = 14695981039346656037ull; // FNV-1a over the files the scene is loaded from
+	for (const auto &fileName : fileNames) {
+		std::ifstream ifs(fileName, std::ios::in | std::ios::binary);
+		char c;
+		while (ifs.get(c)) {
+			hash ^= (unsigned char)c;
+			hash *= 1099511628211ull;
+		}
+		hash ^= 0xff; // separate the files
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool TestApp::openSpool() const {
+	int numJobs = mCyRange.size() * mCvRange.size() * mTTRRange.size() * mDRange.size() * mNumExpts;
+	char sweep[100];
+	sprintf_s(sweep, "%u %d\n", mRandomSeed, numJobs);
+
+	std::ifstream ifs(mSpoolDir + "sweep.txt", std::ios::in);
+	if (ifs.good()) {
+		std::string line;
+		std::getline(ifs, line);
+		if (line + "\n" != sweep) {
+			cout << mSpoolDir << " belongs to another sweep (" << line << ")" << endl;
+			return false;
+		}
+	}
+	ifs.close();
+
+	publish(mSpoolDir + "sweep.txt", sweep, ".tmp");
+	std::remove((mSpoolDir + "finished").c_str());
+	return true;
+}
+
+void TestApp::closeSpool() const {
+	publish(mSpoolDir + "finished", "", ".tmp");
+}
+
+void TestApp::runExperiments_spool(const std::vector<Job> &jobs, const arrayNi &toDoList, arrayNi &timesteps, arrayNf &avgTravelTimesteps, std::vector<VolunteerStats> &volunteerStats, std::ofstream &ofs) const {
+	char descriptor[300];
+	unsigned long long scene = getSceneFingerprint();
+
+	/*
+	 * Collect the results published by workers into the job file, until every job in toDoList is finished.
+	 *  A job with neither a result, a descriptor nor a claim is (re)published, and a claim that has not been touched for mLeaseTime seconds is put back to the queue,
+	 *  since its worker has crashed. Running a job twice is harmless, as its seeds determine the result.
+	 *  The modification times of claims are set by the share, which may be on another host, so the lease is measured against the clock of the share, not of this process.
+	 */
+	arrayNi remaining(toDoList);
+	int numUnflushed = 0;
+	while (!remaining.empty()) {
+		arrayNi notFinished;
+		time_t now = getShareTime(mSpoolDir);
+		for (const auto &i : remaining) {
+			std::ifstream ifs(getSpoolFileName(i, ".csv"), std::ios::in);
+			std::string line;
+			bool hasResult = (bool)std::getline(ifs, line);
+			if (hasResult && line.compare(0, jobs[i].mKey.size() + 2, jobs[i].mKey + ", ") == 0 &&
+				readRecord(line.c_str() + jobs[i].mKey.size(), timesteps[i], avgTravelTimesteps[i], volunteerStats[i])) {
+				ofs << line << "\n";
+				if (++numUnflushed == mFlushInterval) {
+					ofs.flush();
+					numUnflushed = 0;
+				}
+
+				cout << ".";
+				continue;
+			}
+			ifs.close();
+			if (hasResult) // written by an older version, so run the job again
+				std::remove(getSpoolFileName(i, ".csv").c_str());
+
+			std::string claimFileName = getSpoolFileName(i, ".claimed");
+			struct stat info;
+			if (stat(claimFileName.c_str(), &info) == 0) {
+				if (difftime(now, info.st_mtime) > mLeaseTime)
+					std::rename(claimFileName.c_str(), getSpoolFileName(i, ".txt").c_str());
+			}
+			else if (!isExisting(getSpoolFileName(i, ".txt"))) {
+				sprintf_s(descriptor, "SCENE %016llx\nPARAMETERS %.9g %.9g %d %.9g %u %u %.9g\nKEY %s\n", scene, jobs[i].mCy, jobs[i].mCv, jobs[i].mTTR, jobs[i].mD,
+					jobs[i].mSeeds[0], jobs[i].mSeeds[1], jobs[i].mAroundVolunteersDist, jobs[i].mKey.c_str());
+				publish(getSpoolFileName(i, ".txt"), descriptor, ".tmp");
+			}
+			notFinished.push_back(i);
+		}
+		remaining.swap(notFinished);
+
+		if (!remaining.empty())
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+	ofs.flush();
+}
+
+void TestApp::runWorker() {
+	std::string workerID = std::to_string(std::random_device{}());
+	unsigned long long scene = getSceneFingerprint();
+	char sceneLine[100];
+	sprintf_s(sceneLine, "SCENE %016llx", scene);
+	cout << "Worker " << workerID << " on " << mSpoolDir << endl;
+
+	ObstacleRemovalModel model(mScene);
+	int numRuns = 0;
+	unsigned int offset = std::stoul(workerID); // workers scan the queue from different jobs
+	for (;;) {
+		int numJobs = 0;
+		std::ifstream ifs_sweep(mSpoolDir + "sweep.txt", std::ios::in);
+		unsigned int randomSeed;
+		ifs_sweep >> randomSeed >> numJobs;
+		ifs_sweep.close();
+
+		bool isIdle = true;
+		for (int n = 0; n < numJobs; n++) {
+			int i = (offset + n) % numJobs;
+			std::string jobFileName = getSpoolFileName(i, ".txt"), claimFileName = getSpoolFileName(i, ".claimed");
+
+			/*
+			 * Read the descriptor before claiming it, and leave the jobs of other scenes to other workers.
+			 */
+			std::ifstream ifs(jobFileName, std::ios::in);
+			std::string line, key;
+			Job job;
+			if (!std::getline(ifs, line) || line.compare(sceneLine) != 0 ||
+				!std::getline(ifs, line) ||
+				sscanf_s(line.c_str(), "PARAMETERS %f %f %d %f %u %u %f", &job.mCy, &job.mCv, &job.mTTR, &job.mD, &job.mSeeds[0], &job.mSeeds[1], &job.mAroundVolunteersDist) != 7 ||
+				!std::getline(ifs, key) || key.compare(0, 4, "KEY ") != 0)
+				continue;
+			ifs.close();
+			job.mKey = key.substr(4);
+
+			/*
+			 * Claim the job. Only one worker can rename the descriptor, and writing to the claim updates its modification time.
+			 */
+			if (std::rename(jobFileName.c_str(), claimFileName.c_str()) != 0)
+				continue;
+			auto touch = [&]() {
+				FILE *fp;
+				if (fopen_s(&fp, claimFileName.c_str(), "r+") != 0) // the claim has expired
+					return;
+				fseek(fp, 0, SEEK_END);
+				fprintf(fp, "%s\n", workerID.c_str());
+				fclose(fp);
+			};
+			touch();
+			isIdle = false;
+			if (isExisting(getSpoolFileName(i, ".csv"))) { // finished by a worker whose claim had expired
+				std::remove(claimFileName.c_str());
+				continue;
+			}
+
+			time_t lastTouch = time(nullptr);
+			int timesteps;
+			float avgTravelTimesteps;
+			VolunteerStats stats;
+			std::string record = runExperiment(job, model, timesteps, avgTravelTimesteps, stats, [&]() {
+				if (difftime(time(nullptr), lastTouch) * 4 > mLeaseTime) { // keep the claim
+					touch();
+					lastTouch = time(nullptr);
+				}
+			});
+			publish(getSpoolFileName(i, ".csv"), record, "." + workerID + ".tmp");
+			std::remove(claimFileName.c_str());
+			numRuns++;
+
+			cout << ".";
+		}
+
+		if (isIdle) {
+			if (isExisting(mSpoolDir + "finished"))
+				break;
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+	}
+
+	cout << endl << "Worker " << workerID << " ran " << numRuns << " job(s)" << endl;
+}
@@ -0,0 +1,62 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/partitioner.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/task_arena.h>
+#include <mutex>
+
+#include "testApp.h"
+
+struct RunExperiments {
+	tbb::enumerable_thread_specific<ObstacleRemovalModel> *mModels; // one model per thread
+	const std::vector<Job> *mJobs;
+	const arrayNi *mToDoList;
+	arrayNi *mTimesteps;
+	arrayNf *mAvgTravelTimesteps;
+	std::vector<VolunteerStats> *mVolunteerStats;
+	const TestApp *mTestApp;
+	std::ofstream *mOfs;
+	std::mutex *mMutex;  // guard mOfs and mNumUnflushed
+	int *mNumUnflushed;
+	int mFlushInterval;
+
+	void operator() (const tbb::blocked_range<int> &r) const {
+		for (int i = r.begin(); i != r.end(); i++) {
+			// the model runs its own parallel loops, so isolate it to keep this thread from picking up another experiment that would reuse the same model
+			tbb::this_task_arena::isolate([&] { runExperiment((*mToDoList)[i]); });
+		}
+	}
+
+	void runExperiment(int i) const {
+		std::string record = (*mTestApp).runExperiment((*mJobs)[i], (*mModels).local(), (*mTimesteps)[i], (*mAvgTravelTimesteps)[i], (*mVolunteerStats)[i]);
+		std::lock_guard<std::mutex> lock(*mMutex);
+		*mOfs << record;
+		if (++*mNumUnflushed == mFlushInterval) {
+			mOfs->flush();
+			*mNumUnflushed = 0;
+		}
+
+		cout << ".";
+	}
+};
+
+void TestApp::runExperiments_tbb(const std::vector<Job> &jobs, const arrayNi &toDoList, arrayNi &timesteps, arrayNf &avgTravelTimesteps, std::vector<VolunteerStats> &volunteerStats, std::ofstream &ofs) const {
+	tbb::enumerable_thread_specific<ObstacleRemovalModel> models(mScene); // copied from the scene instead of loading the files again
+	std::mutex mutex;
+	int numUnflushed = 0;
+
+	RunExperiments body;
+	body.mModels = &models;
+	body.mJobs = &jobs;
+	body.mToDoList = &toDoList;
+	body.mTimesteps = &timesteps;
+	body.mAvgTravelTimesteps = &avgTravelTimesteps;
+	body.mVolunteerStats = &volunteerStats;
+	body.mTestApp = this;
+	body.mOfs = &ofs;
+	body.mMutex = &mutex;
+	body.mNumUnflushed = &numUnflushed;
+	body.mFlushInterval = mFlushInterval;
+	tbb::parallel_for(tbb::blocked_range<int>(0, toDoList.size(), 1), body, tbb::simple_partitioner()); // every task runs a whole simulation
+	ofs.flush();
+}